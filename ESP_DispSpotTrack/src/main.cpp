@@ -16,13 +16,18 @@
  */
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include <EEPROM.h>
+#include <ESP8266HTTPClient.h>
 #include <ESP8266WebServer.h>
 #include <ESP8266WiFi.h>
 #include <ESP8266mDNS.h>
+#include <LittleFS.h>
 #include <MD_MAX72xx.h>
 #include <MD_Parola.h>
 #include <PubSubClient.h>
+#include <Updater.h>
+#include <WebSocketsServer.h>
 
 // ============ Version ============
 #define FIRMWARE_VERSION "0.1.0"
@@ -34,18 +39,72 @@
 
 // Network
 #define AP_SSID "ESP8266-Setup"
-#define MQTT_TOPIC "home_assistant/spotify/current"
+#define MQTT_TOPIC_BASE "home_assistant/spotify" // Default, configurable via /api/settings
+#define MQTT_TOPIC_SIZE 80                         // Base (max 63) + longest suffix
 
 // Hardware Pins
 #define CLK_PIN D5 // GPIO14
 #define CS_PIN D7  // GPIO13
 #define DIN_PIN D8 // GPIO15
 
-// MAX7219
+// MAX7219 (geometry derived at compile time, see Display Geometry)
 #define MAX_DEVICES 4 // 4 x 8×8 = 8×32 matrix
 #define HARDWARE_TYPE MD_MAX72XX::FC16_HW
 #define MAX_INTENSITY 3
 
+// Live channel (WebSocket)
+#define WS_PORT 81
+#define MIRROR_KEYFRAME 0x01 // [type][column x Geometry::kColumns]
+#define MIRROR_DELTA 0x02    // [type][changed-column bitmask][changed columns]
+#define MIRROR_KEYFRAME_INTERVAL 50
+#define MIRROR_MAX_FPS 25
+
+// OTA updates
+#define OTA_CHUNK_SIZE 1024    // Bytes read per write to flash (MQTT pull)
+#define OTA_STALL_TIMEOUT 10000 // Abort a pull when no data arrives for 10s
+#define OTA_URL_SIZE 160
+#define OTA_USERNAME "admin" // HTTP Basic auth user for /update, password from the config form
+
+// Idle mode
+#define IDLE_TIMEOUT_DEFAULT 120 // Seconds without playback before the display sleeps
+#define IDLE_TIMEOUT_MAX 3600
+#define IDLE_FADE_STEP 60   // ms per intensity step while fading out
+#define IDLE_LOOP_DELAY 50  // ms, loop() cadence while idle (MQTT wakes within this)
+
+// Trace record/replay
+#define TRACE_CAPACITY 32      // Events kept in RAM (ring buffer while recording)
+#define TRACE_CHANNEL_SIZE 24  // Topic relative to topic_base, or HTTP path
+#define TRACE_PAYLOAD_SIZE 80  // Longer payloads are truncated (display shows 64 chars)
+#define TRACE_MQTT 'm'
+#define TRACE_HTTP 'h'
+#define TRACE_SYSTEM 's' // "disconnect" drops the MQTT session
+
+// Latency (message received -> first lit frame of the new text)
+#define LATENCY_BUCKETS 48         // Bucket bounds grow by 20%: 10ms ... ~50s
+#define LATENCY_HTTP_WINDOW 1000   // ms after an HTTP request that counts as HTTP load
+#define LATENCY_RECONNECT_WINDOW 10000 // ms after an MQTT connect that counts as reconnect
+
+// Home Assistant
+#define HA_DISCOVERY_PREFIX "homeassistant"
+#define HA_STATE_INTERVAL 1000  // ms, changes within this window share one publish
+#define HA_STATE_REFRESH 60000  // ms, republish diagnostics (RSSI, heap) at least this often
+#define HA_BUFFER_SIZE 640      // Largest discovery config
+#define MQTT_BUFFER_SIZE 768    // HA_BUFFER_SIZE + topic + MQTT header
+
+// Track history (LittleFS, 2MB filesystem of the 4m2m layout)
+#define HISTORY_DIR "/history"
+#define HISTORY_SEGMENT_ENTRIES 128 // Lines per segment file before rotating
+#define HISTORY_SEGMENTS 3          // Segments kept, oldest is deleted on rotation
+#define HISTORY_QUEUE 8             // Tracks buffered in RAM between flushes
+#define HISTORY_LINE_SIZE 160       // One NDJSON line
+#define HISTORY_FLUSH_INTERVAL 60000 // ms a track may wait in RAM
+#define NTP_SERVER "pool.ntp.org"
+
+// RAM budgets, checked by static_assert (DRAM is ~80KB, WiFi/TCP need most of it)
+#define DISPLAY_RAM_BUDGET 256 // Scroll text + mirror state
+#define BUFFER_RAM_BUDGET 6144 // Trace, history queue, HA buffer, latency histograms
+#define MIRROR_STACK_BUDGET 256 // Column snapshot + packet streamMirror() builds on the stack
+
 // ============ Configuration Structure ============
 struct Config
 {
@@ -61,19 +120,214 @@ struct Config
 Config config;
 bool config_valid = false;
 
+// ============ Trace Structure ============
+// One line per event: <ms>\t<source>\t<channel>\t<payload>
+struct TraceEvent
+{
+  uint32_t at_ms;
+  char source;
+  char channel[TRACE_CHANNEL_SIZE];
+  char payload[TRACE_PAYLOAD_SIZE];
+};
+
+TraceEvent trace[TRACE_CAPACITY];
+uint8_t trace_count = 0;
+uint8_t trace_head = 0; // Oldest event while recording
+bool trace_recording = false;
+
+// Replay runs the trace through the normal handlers on a scaled clock
+bool replay_active = false;
+uint8_t replay_index = 0;
+uint16_t replay_speed = 1;
+unsigned long replay_started = 0;
+
+// Replay report, reset when a replay starts
+unsigned long replay_duration = 0;
+uint32_t replay_frames = 0;
+uint32_t late_frames = 0;    // Frames pushed more than half a tick late
+uint32_t frame_late_max = 0; // ms
+uint32_t loop_us_max = 0;
+uint32_t heap_min = 0;
+uint32_t eeprom_commits = 0; // Counted always, reported relative to replay start
+uint32_t replay_commits_base = 0;
+
+// ============ Latency Structure ============
+enum LatencyCondition
+{
+  LATENCY_IDLE,
+  LATENCY_HTTP_LOAD,
+  LATENCY_RECONNECT,
+  LATENCY_CONDITIONS
+};
+
+struct LatencyStats
+{
+  uint16_t buckets[LATENCY_BUCKETS];
+  uint32_t count;
+  uint32_t max_ms;
+};
+
+LatencyStats latency[LATENCY_CONDITIONS];
+unsigned long ingest_at = 0;         // When the message being handled arrived, 0 = not set
+unsigned long latency_start = 0;     // Arrival of the message waiting for its first frame
+bool latency_pending = false;
+LatencyCondition latency_condition = LATENCY_IDLE;
+uint32_t latency_superseded = 0;     // Replaced before their first frame (skip storms)
+unsigned long last_http_request = 0;
+unsigned long mqtt_connected_at = 0;
+bool latency_suite = false; // Suite traffic: tracks are shown, not saved or added to history
+
+// ============ Home Assistant Structure ============
+struct DiscoveryEntity
+{
+  const char *component;
+  const char *key; // Field in the state document, also the object id
+  const char *name;
+  const char *extra; // Component specific fields, each followed by a comma
+};
+
+const DiscoveryEntity discovery_entities[] = {
+    {"number", "brightness", "Brightness", "\"cmd_t\":\"~/brightness\",\"min\":0,\"max\":15,"},
+    {"number", "scroll_speed", "Scroll speed",
+     "\"cmd_t\":\"~/scroll_speed\",\"min\":50,\"max\":500,\"step\":10,\"unit_of_meas\":\"ms\","},
+    {"sensor", "track", "Track", "\"ic\":\"mdi:music\","},
+    {"sensor", "display", "Display", "\"ic\":\"mdi:dots-grid\","},
+    {"sensor", "rssi", "WiFi signal",
+     "\"dev_cla\":\"signal_strength\",\"unit_of_meas\":\"dBm\",\"ent_cat\":\"diagnostic\","},
+    {"sensor", "heap", "Free heap", "\"unit_of_meas\":\"B\",\"ent_cat\":\"diagnostic\","},
+};
+const uint8_t DISCOVERY_COUNT = sizeof(discovery_entities) / sizeof(discovery_entities[0]);
+
+char ha_buffer[HA_BUFFER_SIZE];      // Shared by discovery and state, never reallocated
+uint8_t ha_discovery_next = 0;       // Next config to publish, one per loop() pass
+bool ha_state_dirty = false;
+unsigned long ha_last_publish = 0;
+
+// Track history: append-only segment files /history/<seq>.log, one NDJSON
+// line per track, fed from a RAM queue so flash writes stay off the ingest path
+bool history_ready = false;
+uint32_t history_first_seq = 0;   // Oldest segment on flash
+uint32_t history_seq = 0;         // Segment being appended to
+uint16_t history_segment_entries = 0;
+char history_queue[HISTORY_QUEUE][HISTORY_LINE_SIZE];
+uint8_t history_pending = 0;
+unsigned long history_oldest_pending = 0;
+uint32_t history_flushes = 0;
+uint32_t history_dropped = 0;
+String history_last_track = ""; // Skip repeats of the same track
+
+// ============ Display Geometry ============
+// Matrix size and module type are template parameters, so buffer sizes, loop
+// bounds and column order are constants the compiler folds into the pipeline.
+// Per-module wiring (FC16_HW, GENERIC_HW, ...) is mapped by MD_MAX72XX inside
+// getColumn()/setPoint(); the pipeline only sees logical columns.
+template <uint8_t Devices, MD_MAX72XX::moduleType_t Hardware> struct MatrixGeometry
+{
+  static_assert(Devices > 0 && Devices <= 16, "1-16 cascaded modules supported");
+
+  static constexpr MD_MAX72XX::moduleType_t kHardware = Hardware;
+  static constexpr uint8_t kDevices = Devices;
+  static constexpr uint8_t kRows = 8;
+  static constexpr uint8_t kColumns = Devices * 8;
+  static constexpr uint8_t kMaskBytes = (kColumns + 7) / 8;
+  static constexpr uint8_t kTextLength = 64; // Characters shown from a message
+  static constexpr uint8_t kPadding = 4;     // Blanks each side, text scrolls fully in and out
+  static constexpr uint8_t kScrollSize = kPadding + kTextLength + kPadding + 1;
+  static constexpr uint8_t kFrameSize = 1 + kMaskBytes + kColumns; // Largest mirror packet
+
+  // MD_MAX72XX column 0 is the rightmost one, the pipeline counts from the left
+  static constexpr uint8_t column(uint8_t from_left) { return kColumns - 1 - from_left; }
+};
+
+using Geometry = MatrixGeometry<MAX_DEVICES, HARDWARE_TYPE>;
+
+// Uppercase printable ASCII (the font has nothing else), capped and padded so
+// the scroll starts and ends on a blank display. Returns the length.
+template <class Geo> uint8_t buildScrollText(const char *message, char (&out)[Geo::kScrollSize])
+{
+  uint8_t length = 0;
+  for (uint8_t i = 0; i < Geo::kPadding; i++)
+    out[length++] = ' ';
+
+  for (const char *p = message; *p != 0 && length < Geo::kPadding + Geo::kTextLength; p++)
+  {
+    if (*p >= 32 && *p <= 126)
+      out[length++] = toupper(*p);
+  }
+
+  for (uint8_t i = 0; i < Geo::kPadding; i++)
+    out[length++] = ' ';
+  out[length] = 0;
+  return length;
+}
+
+// Copy the framebuffer as bit-packed columns (one byte = 8 rows), leftmost first
+template <class Geo> void captureFrame(MD_MAX72XX &matrix, uint8_t (&columns)[Geo::kColumns])
+{
+  for (uint8_t i = 0; i < Geo::kColumns; i++)
+  {
+    columns[i] = matrix.getColumn(Geo::column(i));
+  }
+}
+
+// Encode a captured frame as a keyframe, or as a delta against prev. prev is
+// updated to the frame. Returns the packet length, 0 when a delta found no change.
+template <class Geo>
+size_t encodeMirrorFrame(const uint8_t (&columns)[Geo::kColumns], uint8_t (&prev)[Geo::kColumns],
+                         bool keyframe, uint8_t (&frame)[Geo::kFrameSize])
+{
+  if (keyframe)
+  {
+    frame[0] = MIRROR_KEYFRAME;
+    memcpy(prev, columns, Geo::kColumns);
+    memcpy(frame + 1, columns, Geo::kColumns);
+    return 1 + Geo::kColumns;
+  }
+
+  frame[0] = MIRROR_DELTA;
+  memset(frame + 1, 0, Geo::kMaskBytes);
+  size_t length = 1 + Geo::kMaskBytes;
+  for (uint8_t i = 0; i < Geo::kColumns; i++)
+  {
+    uint8_t column = columns[i];
+    if (column != prev[i])
+    {
+      prev[i] = column;
+      frame[1 + i / 8] |= 1 << (i % 8);
+      frame[length++] = column;
+    }
+  }
+  return length == 1 + Geo::kMaskBytes ? 0 : length;
+}
+
+// True once any LED is on
+template <class Geo> bool frameLit(MD_MAX72XX &matrix)
+{
+  for (uint8_t i = 0; i < Geo::kColumns; i++)
+  {
+    if (matrix.getColumn(i) != 0)
+      return true;
+  }
+  return false;
+}
+
 // ============ Global Objects ============
 ESP8266WebServer server(80);
+WebSocketsServer webSocket(WS_PORT);
 WiFiClient wifiClient;
 PubSubClient mqtt(wifiClient);
-MD_MAX72XX mx(HARDWARE_TYPE, CS_PIN, MAX_DEVICES);
-MD_Parola display(MD_MAX72XX::FC16_HW, DIN_PIN, CLK_PIN, CS_PIN, MAX_DEVICES);
+MD_Parola display(Geometry::kHardware, DIN_PIN, CLK_PIN, CS_PIN, Geometry::kDevices);
 
 // ============ Global Variables ============
 String current_message = "";
-String scroll_text = ""; // Store the scrolling text
+char scroll_text[Geometry::kScrollSize] = ""; // Parola scrolls from this buffer, never reallocated
 unsigned long last_mqtt_attempt = 0;
 const unsigned long MQTT_RECONNECT_INTERVAL = 5000; // 5 seconds
-bool display_enabled = true;
+const unsigned long WIFI_CONNECT_TIMEOUT = 20000;   // 20 seconds per attempt
+unsigned long wifi_connect_started = 0;             // 0 = no attempt in progress
+bool wifi_apply_pending = false;                    // WiFi credentials changed, reconnect
+bool mqtt_apply_pending = false;                    // MQTT settings changed, reconnect
+bool display_enabled = true;               // false while idle (MAX7219 in shutdown)
 unsigned long wifi_connected_time = 0;    // Track when WiFi connects
 bool ready_shown = false;                 // Track if READY was shown
 bool message_looping = false;             // Track if we're looping a message
@@ -83,6 +337,86 @@ const int EEPROM_MESSAGE_START = 256;     // Where to store last message
 const int EEPROM_MESSAGE_SIZE = 128;      // Max size of message
 const int EEPROM_BRIGHTNESS_ADDR = 384;   // Brightness setting
 const int EEPROM_SCROLL_SPEED_ADDR = 385; // Scroll speed (2 bytes: high, low)
+const int EEPROM_MIRROR_FPS_ADDR = 387;   // Framebuffer mirror rate
+const int EEPROM_TOPIC_ADDR = 388;        // MQTT topic base
+const int EEPROM_TOPIC_SIZE = 64;         // Max size of topic base
+const int EEPROM_IDLE_TIMEOUT_ADDR = 452; // Idle timeout in seconds (2 bytes: high, low)
+const int EEPROM_OTA_PASSWORD_ADDR = 454; // Update password, empty = updates disabled
+const int EEPROM_OTA_PASSWORD_SIZE = 32;
+
+// MQTT topics, derived from topic_base by buildTopics()
+char topic_base[EEPROM_TOPIC_SIZE] = MQTT_TOPIC_BASE;
+char topic_current[MQTT_TOPIC_SIZE];
+char topic_brightness[MQTT_TOPIC_SIZE];
+char topic_scroll_speed[MQTT_TOPIC_SIZE];
+char topic_set[MQTT_TOPIC_SIZE];
+char topic_ota[MQTT_TOPIC_SIZE];
+char topic_state[MQTT_TOPIC_SIZE];
+char topic_status[MQTT_TOPIC_SIZE];       // Retained device state document
+char topic_availability[MQTT_TOPIC_SIZE]; // online/offline (last will)
+
+// Settings live before the replay (or last saved by a real request during it),
+// restored by endReplay()
+struct SettingsSnapshot
+{
+  int brightness;
+  int scroll_speed;
+  int mirror_fps;
+  int idle_timeout;
+  char topic_base[EEPROM_TOPIC_SIZE];
+};
+
+SettingsSnapshot replay_snapshot;
+bool replay_dispatching = false; // Inside dispatchTraceEvent(), commits are only counted
+
+// Framebuffer mirror streamed to WebSocket clients
+int mirror_fps = 10;                      // Frames per second, 0 = off
+uint8_t mirror_prev[Geometry::kColumns];  // Last frame sent, for delta encoding
+bool mirror_keyframe_pending = true;      // Next frame is sent in full
+uint8_t mirror_frames_since_keyframe = 0; // Periodic keyframe for late joiners
+unsigned long mirror_last_frame = 0;
+uint32_t mirror_frames = 0;         // Frames sent
+uint32_t mirror_encode_us_max = 0;  // Capture + encode time per frame
+uint32_t mirror_encode_us_total = 0;
+bool ws_state_dirty = false; // Push a state message on next loop
+
+// OTA state
+bool ota_active = false;
+size_t ota_total = 0;   // Expected image size (0 = unknown)
+size_t ota_written = 0; // Bytes written to flash so far
+String ota_error = "";
+unsigned long ota_reboot_at = 0; // Restart once the response is out
+char ota_pull_url[OTA_URL_SIZE] = "";
+char ota_pull_md5[33] = "";
+bool ota_pulling = false;        // Download in progress, one chunk per loop() pass
+unsigned long ota_last_data = 0; // For the stall timeout
+WiFiClient ota_client;
+HTTPClient ota_http;
+bool upload_accepted = false; // The current /update request owns the Update session
+String upload_error = "";     // Why the current /update request was refused
+char ota_password[EEPROM_OTA_PASSWORD_SIZE] = ""; // Required by /update and the ota topic
+
+// Idle mode and power counters
+int idle_timeout = IDLE_TIMEOUT_DEFAULT; // Seconds, 0 = never idle
+bool playing = false;                    // Spotify play state
+unsigned long idle_since = 0;            // When playback last stopped
+int fade_level = -1;                     // Intensity while fading out, -1 = not fading
+unsigned long fade_last_step = 0;
+unsigned long power_state_since = 0;
+uint64_t active_ms = 0; // Time with the display running
+uint64_t idle_ms = 0;   // Time in shutdown
+uint32_t frames_pushed = 0;
+unsigned long last_frame_at = 0; // Reset whenever animation (re)starts, see animateDisplay()
+WiFiSleepType_t sleep_before_idle = WIFI_NONE_SLEEP; // Restored on wake
+bool ap_stopped_for_idle = false; // Modem sleep only applies in STA-only mode
+
+static_assert(sizeof(scroll_text) + sizeof(mirror_prev) <= DISPLAY_RAM_BUDGET,
+              "display pipeline exceeds DISPLAY_RAM_BUDGET");
+static_assert(sizeof(trace) + sizeof(history_queue) + sizeof(ha_buffer) + sizeof(latency) <=
+                  BUFFER_RAM_BUDGET,
+              "static buffers exceed BUFFER_RAM_BUDGET");
+static_assert(Geometry::kColumns + Geometry::kFrameSize <= MIRROR_STACK_BUDGET,
+              "mirror frame too large for the stack");
 
 // ============ Function Declarations ============
 void loadConfig();
@@ -91,25 +425,89 @@ void resetConfig();
 void loadLastMessage();
 void saveLastMessage(const String &message);
 void loadBrightness();
-void saveBrightness();
 void loadScrollSpeed();
-void saveScrollSpeed();
+void loadTopics();
+void loadMirrorFps();
+void loadIdleTimeout();
+void loadOtaPassword();
+void saveOtaPassword(const String &password);
+bool otaAuthorized(const char *password);
+void buildTopics();
+void saveSettings();
+bool applySettings(JsonVariantConst settings, String &error);
+void settingsToJson(String &json);
 void createAccessPoint();
 void setupWebServer();
 void setupMQTT();
 void setupDisplay();
+void startWiFi();
+void startSoftAP();
 void connectWiFi();
 void connectMQTT();
+void applyPendingConfig();
 void handleRoot();
 void handleConfig();
+void handleStatusAPI();
+void handleSettingsAPI();
 void handleBrightnessAPI();
 void handleScrollSpeedAPI();
 void handleTestMessageAPI();
 void handleNotFound();
+void setupLiveChannel();
+void handleLiveChannel();
+void webSocketEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length);
+void notifyStateChanged();
+void broadcastState();
+void streamMirror();
+bool otaBegin(size_t size, const char *md5);
+bool otaWrite(uint8_t *data, size_t length);
+bool otaEnd();
+void otaProgress();
+void handleOta();
+void startOtaPull();
+void runOtaPull();
+void finishOtaPull();
+void handleUpdateUpload();
+void handleUpdateDone();
+void commitEEPROM();
+void recordTrace(char source, const char *channel, const char *payload);
+void handleTraceAPI();
+void handleTraceRecordAPI();
+void rejectTrace(const String &reason);
+void handleTraceReplayAPI();
+void handleTraceReportAPI();
+void runReplay();
+void snapshotSettings();
+void endReplay();
+void dispatchTraceEvent(const TraceEvent &event);
+void handleMqttMessage(const char *topic, char *buffer);
+void startLatency();
+void checkLatency();
+void recordLatency(LatencyStats &stats, uint32_t ms);
+uint32_t latencyPercentile(const LatencyStats &stats, uint8_t percent);
+void handleLatencyAPI();
+void handleHomeAssistant();
+bool publishDiscovery(const DiscoveryEntity &entity);
+size_t utf8Prefix(const char *text, size_t max);
+bool publishState();
+void setupHistory();
+void queueHistory(const String &track);
+void handleHistory();
+void flushHistory();
+void historySegmentPath(char *path, size_t size, uint32_t seq);
+void handleHistoryAPI();
+void setPlaying(bool now_playing);
+void updatePowerState();
+void wakeDisplay();
+void accountPowerTime();
+bool animateDisplay();
 void mqttCallback(char *topic, byte *payload, unsigned int length);
 void updateDisplay(const String &message);
 void loopMessage();
 void scrollText(const String &text);
+#ifdef RENDER_BENCH
+void runRenderBench();
+#endif
 
 // ============ Setup ============
 void setup()
@@ -132,12 +530,23 @@ void setup()
   // Load display settings from EEPROM
   loadBrightness();
   loadScrollSpeed();
+  loadTopics();
+  loadMirrorFps();
+  loadIdleTimeout();
+  loadOtaPassword();
 
   // Initialize display
   setupDisplay();
+#ifdef RENDER_BENCH
+  runRenderBench();
+#endif
+
+  // Track history on LittleFS
+  setupHistory();
 
   // Setup web server (always, for AP + settings access)
   setupWebServer();
+  setupLiveChannel();
 
   if (!config_valid)
   {
@@ -159,10 +568,19 @@ void setup()
 // ============ Main Loop ============
 void loop()
 {
+  unsigned long loop_start = micros();
+
   // Handle WiFi AP mode
   // Handle web server requests (AP mode + mDNS)
   server.handleClient();
   MDNS.update();
+  handleLiveChannel();
+
+  // Apply config saved from the web form without rebooting
+  applyPendingConfig();
+
+  // Pending MQTT-triggered update or post-update restart
+  handleOta();
 
   if (WiFi.getMode() == WIFI_AP && WiFi.status() != WL_CONNECTED)
   {
@@ -177,13 +595,28 @@ void loop()
     return;
   }
 
-  // Handle WiFi STA mode
+  // Handle WiFi STA mode (non-blocking, the display keeps animating while connecting)
   if (WiFi.status() != WL_CONNECTED)
   {
-    Serial.println("[!] WiFi disconnected, reconnecting...");
-    connectWiFi();
-    ready_shown = false;
-    message_looping = false;
+    if (wifi_connect_started == 0)
+    {
+      Serial.println("[!] WiFi disconnected, reconnecting...");
+      startWiFi();
+      ready_shown = false;
+      message_looping = false;
+      latency_pending = false;
+    }
+    else if (millis() - wifi_connect_started > WIFI_CONNECT_TIMEOUT)
+    {
+      Serial.println("[!] WiFi connection failed");
+      wifi_connect_started = 0; // Retry on next pass
+      mqtt_apply_pending = false;
+    }
+  }
+  else if (wifi_connect_started != 0)
+  {
+    Serial.printf("[✓] WiFi connected: %s\n", WiFi.localIP().toString().c_str());
+    wifi_connect_started = 0;
   }
 
   // Show READY for 5 seconds after WiFi connects
@@ -209,7 +642,7 @@ void loop()
   // Handle MQTT connection
   if (!mqtt.connected())
   {
-    if (ready_shown && !message_looping)
+    if (ready_shown && !message_looping && display_enabled)
     {
       // Show connection failed after READY phase
       display.displayClear();
@@ -217,7 +650,7 @@ void loop()
     }
 
     unsigned long now = millis();
-    if (now - last_mqtt_attempt > MQTT_RECONNECT_INTERVAL)
+    if (mqtt_apply_pending || now - last_mqtt_attempt > MQTT_RECONNECT_INTERVAL)
     {
       last_mqtt_attempt = now;
       connectMQTT();
@@ -226,15 +659,34 @@ void loop()
   else
   {
     mqtt.loop();
+    handleHomeAssistant();
   }
 
+  // Feed a replayed trace into the handlers
+  runReplay();
+
+  // Append queued tracks to flash in batches
+  handleHistory();
+
+  // Fade out and sleep when nothing is playing, wake on playback
+  updatePowerState();
+
   // Update display animation for looping messages
-  if (message_looping)
+  if (message_looping && display_enabled)
   {
     loopMessage();
   }
 
-  delay(10);
+  if (replay_active)
+  {
+    uint32_t loop_us = micros() - loop_start;
+    if (loop_us > loop_us_max)
+      loop_us_max = loop_us;
+    if (ESP.getFreeHeap() < heap_min)
+      heap_min = ESP.getFreeHeap();
+  }
+
+  delay(display_enabled ? 10 : IDLE_LOOP_DELAY);
 }
 
 // ============ Configuration Management ============
@@ -258,7 +710,7 @@ void loadConfig()
 void saveConfig()
 {
   EEPROM.put(CONFIG_START, config);
-  EEPROM.commit();
+  commitEEPROM();
   config_valid = true;
   Serial.println("[✓] Config saved to EEPROM");
 }
@@ -267,7 +719,7 @@ void resetConfig()
 {
   memset(&config, 0, sizeof(config));
   EEPROM.put(CONFIG_START, config);
-  EEPROM.commit();
+  commitEEPROM();
   config_valid = false;
   Serial.println("[✓] Config reset");
 }
@@ -283,7 +735,7 @@ void saveLastMessage(const String &message)
   {
     EEPROM.write(EEPROM_MESSAGE_START + i, buffer[i]);
   }
-  EEPROM.commit();
+  commitEEPROM();
   Serial.printf("[✓] Message saved to EEPROM: %s\n", message.c_str());
 }
 
@@ -317,13 +769,6 @@ void loadBrightness()
   }
 }
 
-void saveBrightness()
-{
-  EEPROM.write(EEPROM_BRIGHTNESS_ADDR, brightness);
-  EEPROM.commit();
-  Serial.printf("[✓] Brightness saved to EEPROM: %d\n", brightness);
-}
-
 void loadScrollSpeed()
 {
   byte high = EEPROM.read(EEPROM_SCROLL_SPEED_ADDR);
@@ -337,12 +782,224 @@ void loadScrollSpeed()
   }
 }
 
-void saveScrollSpeed()
+void loadTopics()
+{
+  char buffer[EEPROM_TOPIC_SIZE];
+  for (int i = 0; i < EEPROM_TOPIC_SIZE; i++)
+  {
+    buffer[i] = EEPROM.read(EEPROM_TOPIC_ADDR + i);
+  }
+  buffer[EEPROM_TOPIC_SIZE - 1] = 0;
+
+  if (buffer[0] != 0 && (uint8_t)buffer[0] != 255)
+  {
+    strncpy(topic_base, buffer, EEPROM_TOPIC_SIZE);
+    Serial.printf("[✓] Loaded topic base from EEPROM: %s\n", topic_base);
+  }
+  buildTopics();
+}
+
+void loadMirrorFps()
+{
+  int stored = EEPROM.read(EEPROM_MIRROR_FPS_ADDR);
+  if (stored != 255 && stored <= MIRROR_MAX_FPS)
+  {
+    mirror_fps = stored;
+    Serial.printf("[✓] Loaded mirror_fps from EEPROM: %d\n", mirror_fps);
+  }
+}
+
+void loadIdleTimeout()
+{
+  byte high = EEPROM.read(EEPROM_IDLE_TIMEOUT_ADDR);
+  byte low = EEPROM.read(EEPROM_IDLE_TIMEOUT_ADDR + 1);
+  int stored = (high << 8) | low;
+
+  if (stored != 0xFFFF && stored <= IDLE_TIMEOUT_MAX)
+  {
+    idle_timeout = stored;
+    Serial.printf("[✓] Loaded idle_timeout from EEPROM: %d s\n", idle_timeout);
+  }
+}
+
+void loadOtaPassword()
+{
+  for (int i = 0; i < EEPROM_OTA_PASSWORD_SIZE; i++)
+  {
+    ota_password[i] = EEPROM.read(EEPROM_OTA_PASSWORD_ADDR + i);
+  }
+  ota_password[EEPROM_OTA_PASSWORD_SIZE - 1] = 0;
+
+  if ((uint8_t)ota_password[0] == 255)
+  {
+    ota_password[0] = 0; // Never written
+  }
+  Serial.printf("[→] OTA updates %s\n", ota_password[0] ? "enabled" : "disabled (no password)");
+}
+
+void saveOtaPassword(const String &password)
+{
+  memset(ota_password, 0, EEPROM_OTA_PASSWORD_SIZE);
+  strncpy(ota_password, password.c_str(), EEPROM_OTA_PASSWORD_SIZE - 1);
+  for (int i = 0; i < EEPROM_OTA_PASSWORD_SIZE; i++)
+  {
+    EEPROM.write(EEPROM_OTA_PASSWORD_ADDR + i, ota_password[i]);
+  }
+  commitEEPROM();
+  Serial.println("[✓] OTA password saved to EEPROM");
+}
+
+void buildTopics()
+{
+  snprintf(topic_current, MQTT_TOPIC_SIZE, "%s/current", topic_base);
+  snprintf(topic_brightness, MQTT_TOPIC_SIZE, "%s/brightness", topic_base);
+  snprintf(topic_scroll_speed, MQTT_TOPIC_SIZE, "%s/scroll_speed", topic_base);
+  snprintf(topic_set, MQTT_TOPIC_SIZE, "%s/set", topic_base);
+  snprintf(topic_ota, MQTT_TOPIC_SIZE, "%s/ota", topic_base);
+  snprintf(topic_state, MQTT_TOPIC_SIZE, "%s/state", topic_base);
+  snprintf(topic_status, MQTT_TOPIC_SIZE, "%s/status", topic_base);
+  snprintf(topic_availability, MQTT_TOPIC_SIZE, "%s/availability", topic_base);
+}
+
+// Write all display/MQTT settings with a single EEPROM commit
+void saveSettings()
 {
+  EEPROM.write(EEPROM_BRIGHTNESS_ADDR, brightness);
   EEPROM.write(EEPROM_SCROLL_SPEED_ADDR, (scroll_speed >> 8) & 0xFF);
   EEPROM.write(EEPROM_SCROLL_SPEED_ADDR + 1, scroll_speed & 0xFF);
+  EEPROM.write(EEPROM_MIRROR_FPS_ADDR, mirror_fps);
+  EEPROM.write(EEPROM_IDLE_TIMEOUT_ADDR, (idle_timeout >> 8) & 0xFF);
+  EEPROM.write(EEPROM_IDLE_TIMEOUT_ADDR + 1, idle_timeout & 0xFF);
+  for (int i = 0; i < EEPROM_TOPIC_SIZE; i++)
+  {
+    EEPROM.write(EEPROM_TOPIC_ADDR + i, topic_base[i]);
+  }
+  commitEEPROM();
+  Serial.printf("[✓] Settings saved to EEPROM: brightness=%d speed=%d topic=%s\n", brightness,
+                scroll_speed, topic_base);
+  if (replay_active && !replay_dispatching)
+  {
+    snapshotSettings(); // A real change during a replay is kept when it ends
+  }
+  notifyStateChanged();
+}
+
+// ============ Settings ============
+// Apply any subset of {brightness, scroll_speed, mirror_fps, idle_timeout, topic}. Every field is
+// validated before anything changes, so a bad request leaves all settings as-is.
+bool applySettings(JsonVariantConst settings, String &error)
+{
+  int new_brightness = brightness;
+  int new_speed = scroll_speed;
+  int new_fps = mirror_fps;
+  int new_idle_timeout = idle_timeout;
+  const char *new_topic = topic_base;
+
+  JsonVariantConst value = settings["brightness"];
+  if (!value.isNull())
+  {
+    if (!value.is<int>() || value.as<int>() < 0 || value.as<int>() > 15)
+    {
+      error = "brightness must be 0-15";
+      return false;
+    }
+    new_brightness = value.as<int>();
+  }
+
+  value = settings["scroll_speed"];
+  if (!value.isNull())
+  {
+    if (!value.is<int>() || value.as<int>() < 50 || value.as<int>() > 500)
+    {
+      error = "scroll_speed must be 50-500";
+      return false;
+    }
+    new_speed = value.as<int>();
+  }
+
+  value = settings["mirror_fps"];
+  if (!value.isNull())
+  {
+    if (!value.is<int>() || value.as<int>() < 0 || value.as<int>() > MIRROR_MAX_FPS)
+    {
+      error = "mirror_fps must be 0-25";
+      return false;
+    }
+    new_fps = value.as<int>();
+  }
+
+  value = settings["idle_timeout"];
+  if (!value.isNull())
+  {
+    if (!value.is<int>() || value.as<int>() < 0 || value.as<int>() > IDLE_TIMEOUT_MAX)
+    {
+      error = "idle_timeout must be 0-3600";
+      return false;
+    }
+    new_idle_timeout = value.as<int>();
+  }
+
+  value = settings["topic"];
+  if (!value.isNull())
+  {
+    new_topic = value.as<const char *>();
+    size_t length = new_topic ? strlen(new_topic) : 0;
+    if (length == 0 || length >= (size_t)EEPROM_TOPIC_SIZE || strpbrk(new_topic, "#+") ||
+        new_topic[length - 1] == '/')
+    {
+      error = "topic must be 1-63 chars without wildcards or trailing /";
+      return false;
+    }
+  }
+
+  bool topic_changed = strcmp(new_topic, topic_base) != 0;
+  if (new_brightness == brightness && new_speed == scroll_speed && new_fps == mirror_fps &&
+      new_idle_timeout == idle_timeout && !topic_changed)
+  {
+    return true; // Nothing to persist
+  }
+
+  if (new_brightness != brightness)
+  {
+    brightness = new_brightness;
+    display.setIntensity(brightness);
+  }
+  scroll_speed = new_speed;
+  mirror_fps = new_fps;
+  idle_timeout = new_idle_timeout;
+
+  if (topic_changed)
+  {
+    strncpy(topic_base, new_topic, EEPROM_TOPIC_SIZE - 1);
+    topic_base[EEPROM_TOPIC_SIZE - 1] = 0;
+    buildTopics();
+    mqtt_apply_pending = true; // Resubscribe on a fresh session
+  }
+
+  saveSettings();
+  return true;
+}
+
+void settingsToJson(String &json)
+{
+  StaticJsonDocument<192> doc;
+  doc["brightness"] = brightness;
+  doc["scroll_speed"] = scroll_speed;
+  doc["mirror_fps"] = mirror_fps;
+  doc["idle_timeout"] = idle_timeout;
+  doc["topic"] = (const char *)topic_base;
+  serializeJson(doc, json);
+}
+
+// Every EEPROM commit rewrites a flash sector, count them for replay reports
+void commitEEPROM()
+{
+  eeprom_commits++;
+  if (replay_dispatching)
+  {
+    return; // Counted for the report, dropped by dispatchTraceEvent()
+  }
   EEPROM.commit();
-  Serial.printf("[✓] Scroll speed saved to EEPROM: %d ms\n", scroll_speed);
 }
 
 // ============ WiFi & Network ============
@@ -365,28 +1022,48 @@ void createAccessPoint()
   Serial.println("[✓] IP: 192.168.4.1");
 }
 
-void connectWiFi()
+// Start a WiFi connection without waiting for it; loop() tracks the result
+void startWiFi()
 {
   Serial.printf("[→] Connecting to WiFi: %s\n", config.ssid);
 
   // Mode AP+STA: Garder l'AP actif pour accès web + connexion à réseau principal
+  // Keep an already running AP untouched so web clients stay connected
+  if (WiFi.getMode() != WIFI_AP && WiFi.getMode() != WIFI_AP_STA)
+  {
+    startSoftAP();
+  }
+  else
+  {
+    WiFi.mode(WIFI_AP_STA);
+  }
+
+  // Connecter au réseau WiFi principal
+  WiFi.begin(config.ssid, config.password);
+  wifi_connect_started = millis();
+}
+
+// Setup AP kept up next to the station connection (AP+STA)
+void startSoftAP()
+{
   WiFi.mode(WIFI_AP_STA);
 
-  // Configurer l'AP toujours actif
   String ap_ssid = "ESP8266-Setup-" + String(WiFi.macAddress().substring(9));
   WiFi.softAP(ap_ssid.c_str(), "12345678");
   Serial.printf("[✓] Soft AP started: %s on 192.168.4.1\n", ap_ssid.c_str());
+}
 
-  // Connecter au réseau WiFi principal
-  WiFi.begin(config.ssid, config.password);
+// Blocking connect, used once at boot
+void connectWiFi()
+{
+  startWiFi();
 
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 40)
+  while (WiFi.status() != WL_CONNECTED && millis() - wifi_connect_started < WIFI_CONNECT_TIMEOUT)
   {
     delay(500);
     Serial.print(".");
-    attempts++;
   }
+  wifi_connect_started = 0;
 
   if (WiFi.status() == WL_CONNECTED)
   {
@@ -403,6 +1080,7 @@ void setupMQTT()
 {
   mqtt.setServer(config.mqtt_host, config.mqtt_port);
   mqtt.setCallback(mqttCallback);
+  mqtt.setBufferSize(MQTT_BUFFER_SIZE); // Discovery configs exceed the 256 byte default
 
   Serial.printf("[→] MQTT Server: %s:%d\n", config.mqtt_host, config.mqtt_port);
 }
@@ -416,20 +1094,55 @@ void connectMQTT()
 
   Serial.printf("[→] Connecting to MQTT: %s\n", config.mqtt_host);
 
-  if (mqtt.connect(config.client_id, config.mqtt_user, config.mqtt_pass))
+  if (mqtt.connect(config.client_id, config.mqtt_user, config.mqtt_pass, topic_availability, 0,
+                   true, "offline"))
   {
     Serial.println("[✓] MQTT connected");
-    mqtt.subscribe(MQTT_TOPIC);
-    mqtt.subscribe("home_assistant/spotify/brightness");
-    mqtt.subscribe("home_assistant/spotify/scroll_speed");
-    Serial.printf("[✓] Subscribed to: %s\n", MQTT_TOPIC);
-    Serial.println("[✓] Subscribed to: home_assistant/spotify/brightness");
-    Serial.println("[✓] Subscribed to: home_assistant/spotify/scroll_speed");
+    mqtt_connected_at = millis();
+    mqtt.publish(topic_availability, "online", true);
+
+    // Discovery configs and a fresh state document follow from loop()
+    ha_discovery_next = 0;
+    ha_state_dirty = true;
+    mqtt.subscribe(topic_current);
+    mqtt.subscribe(topic_brightness);
+    mqtt.subscribe(topic_scroll_speed);
+    mqtt.subscribe(topic_set);
+    mqtt.subscribe(topic_ota);
+    mqtt.subscribe(topic_state);
+    Serial.printf("[✓] Subscribed to: %s\n", topic_current);
+    Serial.printf("[✓] Subscribed to: %s\n", topic_brightness);
+    Serial.printf("[✓] Subscribed to: %s\n", topic_scroll_speed);
+    Serial.printf("[✓] Subscribed to: %s\n", topic_set);
+    Serial.printf("[✓] Subscribed to: %s\n", topic_ota);
+    Serial.printf("[✓] Subscribed to: %s\n", topic_state);
   }
   else
   {
     Serial.printf("[!] MQTT connection failed, code: %d\n", mqtt.state());
   }
+  mqtt_apply_pending = false;
+}
+
+// Reconnect WiFi after handleConfig() has answered the request.
+// MQTT changes are picked up by loop() through mqtt_apply_pending.
+void applyPendingConfig()
+{
+  // Topic changes need a fresh session, loop() reconnects and resubscribes
+  if (mqtt_apply_pending && mqtt.connected())
+  {
+    mqtt.disconnect();
+  }
+
+  if (!wifi_apply_pending)
+  {
+    return;
+  }
+
+  wifi_apply_pending = false;
+  Serial.println("[→] Applying new WiFi settings");
+  WiFi.disconnect();
+  startWiFi();
 }
 
 void mqttCallback(char *topic, byte *payload, unsigned int length)
@@ -440,7 +1153,23 @@ void mqttCallback(char *topic, byte *payload, unsigned int length)
     length = 511;
   memcpy(buffer, payload, length);
   buffer[length] = '\0';
+  ingest_at = millis();
+
+  // Record topics relative to the base so traces replay on any device. OTA
+  // requests carry the update password and are never recorded.
+  size_t base_length = strlen(topic_base);
+  bool relative = strncmp(topic, topic_base, base_length) == 0 && topic[base_length] == '/';
+  if (strcmp(topic, topic_ota) != 0)
+  {
+    recordTrace(TRACE_MQTT, relative ? topic + base_length + 1 : topic, buffer);
+  }
+
+  handleMqttMessage(topic, buffer);
+  ingest_at = 0;
+}
 
+void handleMqttMessage(const char *topic, char *buffer)
+{
   String message = String(buffer);
   String topic_str = String(topic);
 
@@ -450,19 +1179,23 @@ void mqttCallback(char *topic, byte *payload, unsigned int length)
   Serial.printf("[MQTT] %s: %s\n", topic, message.c_str());
 
   // Check which topic this is
-  if (topic_str == MQTT_TOPIC)
+  if (topic_str == topic_current)
   {
     // Main display message
     if (message.length() > 0)
     {
       updateDisplay(message);
+      if (!replay_active && !latency_suite)
+      {
+        queueHistory(message); // Replayed or suite traffic is not the user's listening history
+      }
     }
     else
     {
       updateDisplay(""); // Call updateDisplay with empty to clear
     }
   }
-  else if (topic_str == "home_assistant/spotify/brightness")
+  else if (topic_str == topic_brightness)
   {
     // Control brightness
     int new_brightness = message.toInt();
@@ -470,21 +1203,69 @@ void mqttCallback(char *topic, byte *payload, unsigned int length)
     {
       brightness = new_brightness;
       display.setIntensity(brightness);
-      saveBrightness(); // Save to EEPROM
+      saveSettings(); // Save to EEPROM
       Serial.printf("[✓] Brightness set to %d\n", brightness);
     }
   }
-  else if (topic_str == "home_assistant/spotify/scroll_speed")
+  else if (topic_str == topic_scroll_speed)
   {
     // Control scroll speed
     int new_speed = message.toInt();
     if (new_speed >= 50 && new_speed <= 500)
     {
       scroll_speed = new_speed;
-      saveScrollSpeed(); // Save to EEPROM
+      saveSettings(); // Save to EEPROM
       Serial.printf("[✓] Scroll speed set to %d ms\n", scroll_speed);
     }
   }
+  else if (topic_str == topic_set)
+  {
+    // Batched settings update, same JSON as POST /api/settings
+    StaticJsonDocument<256> doc;
+    String error;
+    if (deserializeJson(doc, buffer))
+    {
+      Serial.println("[!] Invalid JSON on set topic");
+    }
+    else if (!applySettings(doc.as<JsonVariantConst>(), error))
+    {
+      Serial.printf("[!] Settings rejected: %s\n", error.c_str());
+    }
+  }
+  else if (topic_str == topic_state)
+  {
+    // Media player state: playing, paused, idle, off...
+    setPlaying(message.equalsIgnoreCase("playing"));
+  }
+  else if (topic_str == topic_ota)
+  {
+    // {"url": "http://host/firmware.bin", "md5": "<32 hex chars>", "password": "..."},
+    // pulled from loop()
+    StaticJsonDocument<320> doc;
+    const char *url = nullptr;
+    const char *md5 = nullptr;
+    const char *password = nullptr;
+    if (!deserializeJson(doc, buffer))
+    {
+      url = doc["url"];
+      md5 = doc["md5"];
+      password = doc["password"];
+    }
+
+    if (!otaAuthorized(password))
+    {
+      Serial.println("[!] OTA request rejected (bad password)");
+    }
+    else if (!url || !md5 || strlen(url) >= OTA_URL_SIZE || strlen(md5) != 32 || ota_active)
+    {
+      Serial.println("[!] OTA request rejected (need url + md5)");
+    }
+    else
+    {
+      strncpy(ota_pull_url, url, OTA_URL_SIZE - 1);
+      strncpy(ota_pull_md5, md5, 32);
+    }
+  }
 }
 
 // ============ Web Server ============
@@ -495,6 +1276,21 @@ void setupWebServer()
   server.on("/api/brightness", handleBrightnessAPI);
   server.on("/api/scroll_speed", handleScrollSpeedAPI);
   server.on("/api/test-message", handleTestMessageAPI);
+  server.on("/api/status", handleStatusAPI);
+  server.on("/api/settings", handleSettingsAPI);
+  server.on("/update", HTTP_POST, handleUpdateDone, handleUpdateUpload);
+  server.on("/api/trace", HTTP_GET, handleTraceAPI);
+  server.on("/api/trace/record", HTTP_POST, handleTraceRecordAPI);
+  server.on("/api/trace/replay", HTTP_POST, handleTraceReplayAPI);
+  server.on("/api/trace/report", HTTP_GET, handleTraceReportAPI);
+  server.on("/api/latency", HTTP_GET, handleLatencyAPI);
+  server.on("/api/history", HTTP_GET, handleHistoryAPI);
+  server.addHook([](const String &, const String &, WiFiClient *,
+                    ESP8266WebServer::ContentTypeFunction)
+                 {
+                   last_http_request = millis();
+                   return ESP8266WebServer::CLIENT_REQUEST_CAN_CONTINUE;
+                 });
   server.onNotFound(handleNotFound);
 
   server.begin();
@@ -555,11 +1351,16 @@ void handleRoot()
     .info { background: #e7f3ff; padding: 10px; border-radius: 4px; margin-bottom: 15px; font-size: 13px; color: #004085; border-left: 4px solid #0056b3; }
     .success { color: green; display: none; margin-top: 10px; font-weight: bold; text-align: center; }
     .setting { margin: 15px 0; padding: 15px; background: #f9f9f9; border-radius: 6px; }
+    #mirror { width: 100%; background: #111; border-radius: 4px; image-rendering: pixelated; }
   </style>
 </head>
 <body>
   <div class="container">
     <h1>🎵 ESP8266 Spotify Display</h1>
+
+    <h2>📺 Live View</h2>
+    <canvas id="mirror" height="80"></canvas>
+    <div class="info" id="liveStatus">Connecting...</div>
     
     <h2>📡 WiFi & MQTT Configuration</h2>
     <div class="info">
@@ -585,6 +1386,12 @@ void handleRoot()
       <label for="mqtt_pass">MQTT Password</label>
       <input type="password" id="mqtt_pass" name="mqtt_pass" placeholder="password (optional)">
       
+      <label for="ota_password">Update Password <span style="color:#999; font-size:12px;\">(leave empty to keep current)</span></label>
+      <input type="password" id="ota_password" name="ota_password" placeholder="Required for OTA updates">
+      
+      <label for="ota_password_current">Current Update Password <span style="color:#999; font-size:12px;\">(needed to change it)</span></label>
+      <input type="password" id="ota_password_current" name="ota_password_current" placeholder="Leave empty if none is set">
+      
       <button type="submit">💾 Save WiFi & MQTT</button>
     </form>
 
@@ -645,20 +1452,100 @@ void handleRoot()
       scrollSpeedValue.textContent = e.target.value;
     });
     
+    // Live channel: state + framebuffer mirror, low-latency commands
+    const COLUMNS = )EOF";
+
+  html += Geometry::kColumns;
+  html += R"EOF(;
+    const columns = new Uint8Array(COLUMNS);
+    const mirrorCanvas = document.getElementById('mirror');
+    mirrorCanvas.width = COLUMNS * 10;
+    const mirror = mirrorCanvas.getContext('2d');
+    const liveStatus = document.getElementById('liveStatus');
+    let ws = null;
+
+    function drawMirror() {
+      mirror.fillStyle = '#111';
+      mirror.fillRect(0, 0, COLUMNS * 10, 80);
+      mirror.fillStyle = '#f33';
+      for (let c = 0; c < COLUMNS; c++) {
+        for (let r = 0; r < 8; r++) {
+          if (columns[c] & (1 << r)) mirror.fillRect(c * 10 + 1, r * 10 + 1, 8, 8);
+        }
+      }
+    }
+
+    function connectLive() {
+      ws = new WebSocket('ws://' + location.hostname + ':81/');
+      ws.binaryType = 'arraybuffer';
+      ws.onopen = () => { liveStatus.textContent = 'Live'; };
+      ws.onclose = () => {
+        liveStatus.textContent = 'Disconnected, retrying...';
+        setTimeout(connectLive, 2000);
+      };
+      ws.onmessage = (e) => {
+        if (typeof e.data === 'string') {
+          const s = JSON.parse(e.data);
+          if (s.type == 'state') {
+            brightness.value = brightnessValue.textContent = s.brightness;
+            scrollSpeed.value = scrollSpeedValue.textContent = s.scroll_speed;
+            liveStatus.textContent = 'Live: ' + (s.message || '(idle)') +
+              ' | frame ' + s.frame_us_avg + '/' + s.frame_us_max + ' us avg/max';
+          } else if (s.type == 'error') {
+            liveStatus.textContent = 'Error: ' + s.error;
+          }
+          return;
+        }
+        const d = new Uint8Array(e.data);
+        if (d[0] == 1) {
+          columns.set(d.subarray(1, 1 + COLUMNS));
+        } else if (d[0] == 2) {
+          const maskBytes = Math.ceil(COLUMNS / 8);
+          let k = 1 + maskBytes;
+          for (let c = 0; c < COLUMNS; c++) {
+            if (d[1 + (c >> 3)] & (1 << (c & 7))) columns[c] = d[k++];
+          }
+        }
+        drawMirror();
+      };
+    }
+
+    function sendLive(cmd) {
+      if (ws && ws.readyState == WebSocket.OPEN) {
+        ws.send(JSON.stringify(cmd));
+        return true;
+      }
+      return false;
+    }
+
+    brightness.addEventListener('change', (e) => {
+      sendLive({ brightness: Number(e.target.value) });
+    });
+
+    scrollSpeed.addEventListener('change', (e) => {
+      sendLive({ scroll_speed: Number(e.target.value) });
+    });
+
+    drawMirror();
+    connectLive();
+    
     function applySettings() {
       const b = brightness.value;
       const s = scrollSpeed.value;
       
-      Promise.all([
-        fetch('/api/brightness?value=' + b),
-        fetch('/api/scroll_speed?value=' + s)
-      ]).then(() => {
+      fetch('/api/settings', {
+        method: 'POST',
+        headers: { 'Content-Type': 'application/json' },
+        body: JSON.stringify({ brightness: Number(b), scroll_speed: Number(s) })
+      }).then(() => {
         success.style.display = 'block';
+        success.textContent = 'Settings applied!';
         setTimeout(() => { success.style.display = 'none'; }, 2000);
       });
     }
     
     function sendTestMessage() {
+      if (sendLive({ text: testMessage.value })) return;
       const msg = encodeURIComponent(testMessage.value);
       fetch('/api/test-message?text=' + msg).then(() => {
         success.style.display = 'block';
@@ -682,6 +1569,20 @@ void handleConfig()
     return;
   }
 
+  // /config itself is open, so replacing a set update password needs the current one
+  // (form field or Basic auth), otherwise anyone on the AP could set their own
+  bool ota_password_change =
+      server.hasArg("ota_password") && server.arg("ota_password").length() > 0;
+  if (ota_password_change && ota_password[0] != 0 &&
+      !otaAuthorized(server.arg("ota_password_current").c_str()) &&
+      !server.authenticate(OTA_USERNAME, ota_password))
+  {
+    server.send(403, "text/plain", "Current update password required, nothing was saved");
+    return;
+  }
+
+  Config previous = config;
+
   // Only update SSID if provided
   if (server.hasArg("ssid") && server.arg("ssid").length() > 0)
   {
@@ -694,6 +1595,12 @@ void handleConfig()
     strncpy(config.password, server.arg("password").c_str(), 63);
   }
 
+  // Only update the OTA password if provided, it is stored outside Config
+  if (ota_password_change)
+  {
+    saveOtaPassword(server.arg("ota_password"));
+  }
+
   // Always update MQTT settings
   strncpy(config.mqtt_host, server.arg("mqtt_host").c_str(), 31);
   config.mqtt_port = server.arg("mqtt_port").toInt();
@@ -707,9 +1614,29 @@ void handleConfig()
   WiFi.macAddress(mac);
   snprintf(config.client_id, 31, "esp8266_spotify_%02x%02x%02x", mac[3], mac[4], mac[5]);
 
-  saveConfig();
+  // Only reconnect what actually changed
+  bool wifi_changed = !config_valid || strcmp(previous.ssid, config.ssid) != 0 ||
+                      strcmp(previous.password, config.password) != 0;
+  bool mqtt_changed = wifi_changed || strcmp(previous.mqtt_host, config.mqtt_host) != 0 ||
+                      previous.mqtt_port != config.mqtt_port ||
+                      strcmp(previous.mqtt_user, config.mqtt_user) != 0 ||
+                      strcmp(previous.mqtt_pass, config.mqtt_pass) != 0 ||
+                      strcmp(previous.client_id, config.client_id) != 0;
+
+  if (mqtt_changed)
+  {
+    saveConfig();
+
+    // New server/credentials, loop() reconnects right away
+    mqtt.disconnect();
+    setupMQTT();
+    mqtt_apply_pending = true;
+  }
+
+  // WiFi is restarted from loop() once this response has been sent
+  wifi_apply_pending = wifi_changed;
 
-  // Send success response
+  // Send success response, the page polls /api/status for the connection result
   String html = R"EOF(
 <!DOCTYPE html>
 <html>
@@ -718,22 +1645,92 @@ void handleConfig()
   <style>
     body { font-family: Arial; text-align: center; padding: 50px; }
     .success { color: green; font-size: 24px; }
+    .failed { color: red; }
   </style>
 </head>
 <body>
   <div class="success">✓ Configuration saved!</div>
-  <p>Device is connecting to WiFi and MQTT...</p>
-  <p>Restarting in 2 seconds...</p>
-  <script>setTimeout(() => window.location = '/', 2000);</script>
+  <p id="status">)EOF";
+
+  html += mqtt_changed ? "Applying new settings..." : "No changes.";
+  html += R"EOF(</p>
+  <p><a href="/">Back</a></p>
+  <script>
+    const status = document.getElementById('status');
+    function poll() {
+      fetch('/api/status').then(r => r.json()).then(s => {
+        if (s.applying) {
+          status.textContent = 'Connecting... WiFi: ' + s.wifi + ', MQTT: ' + s.mqtt;
+          setTimeout(poll, 1000);
+          return;
+        }
+        status.textContent = 'WiFi: ' + s.wifi + (s.ip ? ' (' + s.ip + ')' : '') + ', MQTT: ' + s.mqtt;
+        status.className = s.mqtt == 'connected' ? '' : 'failed';
+      }).catch(() => setTimeout(poll, 1000));
+    }
+)EOF";
+
+  if (mqtt_changed)
+  {
+    html += "    setTimeout(poll, 1000);\n";
+  }
+  html += R"EOF(  </script>
 </body>
 </html>
 )EOF";
 
   server.send(200, "text/html; charset=utf-8", html);
+}
+
+void handleStatusAPI()
+{
+  const char *wifi_status = "disconnected";
+  if (WiFi.status() == WL_CONNECTED)
+    wifi_status = "connected";
+  else if (wifi_apply_pending || wifi_connect_started != 0)
+    wifi_status = "connecting";
+
+  const char *mqtt_status = "failed";
+  if (mqtt.connected())
+    mqtt_status = "connected";
+  else if (mqtt_apply_pending)
+    mqtt_status = "connecting";
 
-  // Restart device
-  delay(2000);
-  ESP.restart();
+  bool applying = wifi_apply_pending || wifi_connect_started != 0 || mqtt_apply_pending;
+
+  String json = "{\"wifi\":\"";
+  json += wifi_status;
+  json += "\",\"ip\":\"";
+  if (WiFi.status() == WL_CONNECTED)
+    json += WiFi.localIP().toString();
+  json += "\",\"mqtt\":\"";
+  json += mqtt_status;
+  json += "\",\"mqtt_state\":";
+  json += mqtt.state();
+  json += ",\"applying\":";
+  json += applying ? "true" : "false";
+  json += ",\"ota\":";
+  json += ota_active && ota_total > 0 ? (int)(ota_written * 100 / ota_total) : -1;
+  json += ",\"ota_error\":\"";
+  json += ota_error; // Last failed update, cleared when the next one starts
+  json += "\"";
+
+  accountPowerTime();
+  json += ",\"display\":\"";
+  json += display_enabled ? (fade_level >= 0 ? "fading" : "active") : "idle";
+  json += "\",\"active_s\":";
+  json += (unsigned long)(active_ms / 1000);
+  json += ",\"idle_s\":";
+  json += (unsigned long)(idle_ms / 1000);
+  json += ",\"frames\":";
+  json += (unsigned long)frames_pushed;
+  json += ",\"history_flushes\":";
+  json += (unsigned long)history_flushes;
+  json += ",\"history_dropped\":";
+  json += (unsigned long)history_dropped;
+  json += "}";
+
+  server.send(200, "application/json", json);
 }
 
 void handleNotFound()
@@ -757,7 +1754,7 @@ void handleBrightnessAPI()
 
   brightness = value;
   display.setIntensity(brightness);
-  saveBrightness(); // Save to EEPROM
+  saveSettings(); // Save to EEPROM
 
   Serial.print("[✓] Brightness set to ");
   Serial.println(brightness);
@@ -780,7 +1777,7 @@ void handleScrollSpeedAPI()
     value = 500;
 
   scroll_speed = value;
-  saveScrollSpeed(); // Save to EEPROM
+  saveSettings(); // Save to EEPROM
 
   Serial.print("[✓] Scroll speed set to ");
   Serial.print(scroll_speed);
@@ -789,19 +1786,1328 @@ void handleScrollSpeedAPI()
   server.send(200, "text/plain", "OK");
 }
 
+void handleSettingsAPI()
+{
+  if (server.method() == HTTP_POST)
+  {
+    recordTrace(TRACE_HTTP, "/api/settings", server.arg("plain").c_str());
+
+    StaticJsonDocument<256> doc;
+    DeserializationError parse_error = deserializeJson(doc, server.arg("plain"));
+    if (parse_error)
+    {
+      server.send(400, "application/json", "{\"error\":\"invalid JSON\"}");
+      return;
+    }
+
+    String error;
+    if (!applySettings(doc.as<JsonVariantConst>(), error))
+    {
+      server.send(400, "application/json", "{\"error\":\"" + error + "\"}");
+      return;
+    }
+  }
+
+  String json;
+  settingsToJson(json);
+  server.send(200, "application/json", json);
+}
+
 void handleTestMessageAPI()
 {
-  if (!server.hasArg("text"))
+  if (!server.hasArg("text"))
+  {
+    server.send(400, "text/plain", "Missing text");
+    return;
+  }
+
+  String test_msg = server.arg("text");
+  recordTrace(TRACE_HTTP, "/api/test-message", test_msg.c_str());
+  Serial.printf("[→] Test message received: %s\n", test_msg.c_str());
+  updateDisplay(test_msg);
+
+  server.send(200, "text/plain", "OK");
+}
+
+// ============ Live Channel (WebSocket) ============
+void setupLiveChannel()
+{
+  webSocket.begin();
+  webSocket.onEvent(webSocketEvent);
+  Serial.printf("[✓] WebSocket live channel on port %d\n", WS_PORT);
+}
+
+void handleLiveChannel()
+{
+  webSocket.loop();
+
+  if (webSocket.connectedClients() == 0)
+  {
+    return;
+  }
+
+  if (ws_state_dirty)
+  {
+    broadcastState();
+  }
+  streamMirror();
+}
+
+void webSocketEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length)
+{
+  if (type == WStype_CONNECTED)
+  {
+    Serial.printf("[✓] WebSocket client %u connected\n", num);
+    mirror_keyframe_pending = true;
+    ws_state_dirty = true;
+    return;
+  }
+
+  if (type != WStype_TEXT)
+  {
+    return;
+  }
+
+  // Commands: {"text": "..."} and/or any /api/settings field
+  StaticJsonDocument<256> doc;
+  String error;
+  if (deserializeJson(doc, payload, length))
+  {
+    error = "invalid JSON";
+  }
+  else if (applySettings(doc.as<JsonVariantConst>(), error))
+  {
+    const char *text = doc["text"];
+    if (text)
+    {
+      updateDisplay(String(text));
+    }
+    return;
+  }
+
+  String reply = "{\"type\":\"error\",\"error\":\"" + error + "\"}";
+  webSocket.sendTXT(num, reply);
+}
+
+void notifyStateChanged()
+{
+  ws_state_dirty = true;
+  ha_state_dirty = true;
+}
+
+void broadcastState()
+{
+  ws_state_dirty = false;
+
+  StaticJsonDocument<384> doc;
+  doc["type"] = "state";
+  doc["brightness"] = brightness;
+  doc["scroll_speed"] = scroll_speed;
+  doc["mirror_fps"] = mirror_fps;
+  doc["message"] = current_message.c_str();
+  doc["mqtt"] = mqtt.connected();
+  doc["display"] = display_enabled ? "active" : "idle";
+  doc["frame_us_max"] = mirror_encode_us_max;
+  doc["frame_us_avg"] = mirror_frames ? mirror_encode_us_total / mirror_frames : 0;
+
+  String json;
+  serializeJson(doc, json);
+  webSocket.broadcastTXT(json);
+}
+
+// Send the LED framebuffer, delta-encoded against the last frame sent
+void streamMirror()
+{
+  if (mirror_fps == 0 || millis() - mirror_last_frame < 1000UL / mirror_fps)
+  {
+    return;
+  }
+  mirror_last_frame = millis();
+
+  unsigned long start = micros();
+
+  uint8_t columns[Geometry::kColumns];
+  uint8_t frame[Geometry::kFrameSize];
+  bool keyframe =
+      mirror_keyframe_pending || mirror_frames_since_keyframe >= MIRROR_KEYFRAME_INTERVAL;
+  captureFrame<Geometry>(*display.getGraphicObject(), columns);
+  size_t length = encodeMirrorFrame<Geometry>(columns, mirror_prev, keyframe, frame);
+
+  if (keyframe)
+  {
+    mirror_keyframe_pending = false;
+    mirror_frames_since_keyframe = 0;
+  }
+  else if (length == 0)
+  {
+    return; // Nothing changed
+  }
+  else
+  {
+    mirror_frames_since_keyframe++;
+  }
+
+  uint32_t elapsed = micros() - start;
+  mirror_encode_us_total += elapsed;
+  if (elapsed > mirror_encode_us_max)
+    mirror_encode_us_max = elapsed;
+  mirror_frames++;
+
+  webSocket.broadcastBIN(frame, length);
+}
+
+// ============ OTA Updates ============
+// Images are streamed to the spare OTA slot of the 4m2m layout chunk by chunk,
+// never buffered whole. Update.end() verifies the MD5 before the new image is
+// marked bootable, a mismatch leaves the running firmware untouched.
+// An MD5 only proves the image arrived intact, not who built it. Both update
+// paths also need the password set in the config form; none set = no updates.
+bool otaAuthorized(const char *password)
+{
+  if (ota_password[0] == 0 || password == nullptr)
+  {
+    return false;
+  }
+
+  size_t length = strlen(ota_password);
+  if (strlen(password) != length)
+  {
+    return false;
+  }
+
+  // Compare every byte so the time taken does not reveal the matching prefix
+  uint8_t diff = 0;
+  for (size_t i = 0; i < length; i++)
+  {
+    diff |= ota_password[i] ^ password[i];
+  }
+  return diff == 0;
+}
+
+bool otaBegin(size_t size, const char *md5)
+{
+  if (ota_active)
+  {
+    ota_error = "update already running";
+    return false;
+  }
+
+  ota_total = size;
+  ota_written = 0;
+  ota_error = "";
+
+  size_t max_size = (ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000;
+  if (size > max_size)
+  {
+    ota_error = "image too large";
+    return false;
+  }
+
+  if (!Update.begin(size > 0 ? size : max_size) || !Update.setMD5(md5))
+  {
+    ota_error = Update.getErrorString();
+    Update.end();
+    return false;
+  }
+
+  ota_active = true;
+  Serial.printf("[→] OTA started: %u bytes, md5 %s\n", (unsigned)size, md5);
+  return true;
+}
+
+bool otaWrite(uint8_t *data, size_t length)
+{
+  if (!ota_active)
+  {
+    return false;
+  }
+
+  if (Update.write(data, length) != length)
+  {
+    ota_error = Update.getErrorString();
+    Update.end();
+    ota_active = false;
+    Serial.printf("[!] OTA write failed: %s\n", ota_error.c_str());
+    return false;
+  }
+
+  ota_written += length;
+  otaProgress();
+  return true;
+}
+
+bool otaEnd()
+{
+  if (!ota_active)
+  {
+    return false;
+  }
+  ota_active = false;
+
+  // evenIfRemaining: the size may only have been an upper bound
+  if (!Update.end(true))
+  {
+    ota_error = Update.getErrorString();
+    Serial.printf("[!] OTA failed: %s\n", ota_error.c_str());
+    return false;
+  }
+
+  Serial.printf("[✓] OTA complete: %u bytes, rebooting\n", (unsigned)ota_written);
+  ota_reboot_at = millis();
+  return true;
+}
+
+// Keep the message scrolling and draw progress on the bottom row
+void otaProgress()
+{
+  wakeDisplay();
+  loopMessage();
+
+  if (ota_total == 0)
+  {
+    return;
+  }
+
+  MD_MAX72XX *matrix = display.getGraphicObject();
+  uint16_t lit = ota_written * Geometry::kColumns / ota_total;
+  for (uint16_t i = 0; i < lit && i < Geometry::kColumns; i++)
+  {
+    matrix->setPoint(Geometry::kRows - 1, Geometry::column(i), true);
+  }
+}
+
+void handleOta()
+{
+  if (ota_reboot_at != 0 && millis() - ota_reboot_at > 1000)
+  {
+    flushHistory();
+    ESP.restart();
+  }
+
+  if (ota_pull_url[0] != 0)
+  {
+    startOtaPull();
+    ota_pull_url[0] = 0;
+  }
+  else if (ota_pulling)
+  {
+    runOtaPull();
+  }
+}
+
+// MQTT-triggered update: download over HTTP straight to flash. The request and
+// headers are handled here, the body is streamed by runOtaPull() from loop().
+void startOtaPull()
+{
+  if (!WiFi.isConnected())
+  {
+    ota_error = "WiFi not connected";
+    return;
+  }
+
+  Serial.printf("[→] OTA pull: %s\n", ota_pull_url);
+
+  ota_http.begin(ota_client, String(ota_pull_url));
+  int code = ota_http.GET();
+  int size = ota_http.getSize();
+
+  if (code != HTTP_CODE_OK || size <= 0)
+  {
+    ota_error = "download failed: HTTP " + String(code) + ", size " + String(size);
+    Serial.printf("[!] OTA %s\n", ota_error.c_str());
+    ota_http.end();
+    return;
+  }
+
+  if (!otaBegin(size, ota_pull_md5))
+  {
+    Serial.printf("[!] OTA rejected: %s\n", ota_error.c_str());
+    ota_http.end();
+    return;
+  }
+
+  ota_pulling = true;
+  ota_last_data = millis();
+}
+
+// Write at most one chunk, so WiFi, MQTT and the web server keep being serviced
+void runOtaPull()
+{
+  static uint8_t chunk[OTA_CHUNK_SIZE];
+  // getStreamPtr() is null once the server has closed the connection
+  WiFiClient *stream = ota_http.getStreamPtr();
+  size_t available = stream != nullptr ? stream->available() : 0;
+
+  if (available > 0)
+  {
+    size_t length = stream->readBytes(chunk, min(available, sizeof(chunk)));
+    if (!otaWrite(chunk, length))
+    {
+      finishOtaPull();
+      return;
+    }
+    ota_last_data = millis();
+  }
+  else if (stream == nullptr || !ota_http.connected() ||
+           millis() - ota_last_data > OTA_STALL_TIMEOUT)
+  {
+    ota_error = "download stalled";
+    Update.end();
+    ota_active = false;
+    Serial.println("[!] OTA download stalled");
+    finishOtaPull();
+    return;
+  }
+
+  if (ota_written >= ota_total)
+  {
+    otaEnd();
+    finishOtaPull();
+  }
+}
+
+void finishOtaPull()
+{
+  ota_http.end();
+  ota_pulling = false;
+}
+
+// POST /update?md5=<hex>[&size=<bytes>] with the image as multipart file, Basic auth
+// OTA_USERNAME / update password
+void handleUpdateUpload()
+{
+  HTTPUpload &upload = server.upload();
+
+  // A refused request must not touch an update already running (MQTT pull),
+  // so its data and end events are ignored and ota_error is left alone
+  if (upload.status == UPLOAD_FILE_START)
+  {
+    upload_accepted = false;
+    upload_error = "";
+
+    if (ota_password[0] == 0 || !server.authenticate(OTA_USERNAME, ota_password))
+    {
+      upload_error = "unauthorized";
+      return;
+    }
+
+    if (ota_active)
+    {
+      upload_error = "update already running";
+      return;
+    }
+
+    if (!server.hasArg("md5") || server.arg("md5").length() != 32)
+    {
+      upload_error = "missing md5";
+      return;
+    }
+
+    size_t size = server.hasArg("size") ? server.arg("size").toInt() : 0;
+    if (!otaBegin(size, server.arg("md5").c_str()))
+    {
+      upload_error = ota_error;
+      return;
+    }
+    upload_accepted = true;
+
+    if (size == 0)
+    {
+      // Request length includes multipart overhead, close enough for progress
+      ota_total = server.clientContentLength();
+    }
+  }
+  else if (!upload_accepted)
+  {
+    return;
+  }
+  else if (upload.status == UPLOAD_FILE_WRITE)
+  {
+    otaWrite(upload.buf, upload.currentSize);
+  }
+  else if (upload.status == UPLOAD_FILE_END)
+  {
+    otaEnd();
+    upload_accepted = false;
+  }
+  else if (upload.status == UPLOAD_FILE_ABORTED)
+  {
+    if (ota_active)
+    {
+      Update.end();
+      ota_active = false;
+      ota_error = "upload aborted";
+    }
+    upload_accepted = false;
+  }
+}
+
+void handleUpdateDone()
+{
+  if (ota_password[0] == 0)
+  {
+    server.send(403, "text/plain", "Updates disabled: set an update password first");
+    return;
+  }
+
+  if (!server.authenticate(OTA_USERNAME, ota_password))
+  {
+    server.requestAuthentication();
+    return;
+  }
+
+  if (upload_error.length() > 0)
+  {
+    server.send(500, "text/plain", "Update failed: " + upload_error);
+    upload_error = "";
+    return;
+  }
+
+  if (ota_reboot_at == 0)
+  {
+    server.send(500, "text/plain", "Update failed: " + ota_error);
+    return;
+  }
+
+  server.send(200, "text/plain", "OK, rebooting");
+}
+
+// ============ Trace Record/Replay ============
+// Recording keeps the last TRACE_CAPACITY events. A replay loads a trace
+// uploaded from a host and dispatches it on a clock scaled by ?speed, while
+// animateDisplay() and loop() collect frame timing, heap and EEPROM counters.
+void recordTrace(char source, const char *channel, const char *payload)
+{
+  if (!trace_recording || replay_active)
+  {
+    return;
+  }
+
+  uint8_t slot = (trace_head + trace_count) % TRACE_CAPACITY;
+  if (trace_count == TRACE_CAPACITY)
+  {
+    trace_head = (trace_head + 1) % TRACE_CAPACITY; // Drop the oldest
+  }
+  else
+  {
+    trace_count++;
+  }
+
+  TraceEvent &event = trace[slot];
+  event.at_ms = millis();
+  event.source = source;
+  strncpy(event.channel, channel, TRACE_CHANNEL_SIZE - 1);
+  event.channel[TRACE_CHANNEL_SIZE - 1] = 0;
+  strncpy(event.payload, payload, TRACE_PAYLOAD_SIZE - 1);
+  event.payload[TRACE_PAYLOAD_SIZE - 1] = 0;
+
+  // Keep the line format intact
+  for (char *c = event.payload; *c; c++)
+  {
+    if (*c == '\t' || *c == '\n' || *c == '\r')
+      *c = ' ';
+  }
+}
+
+// GET /api/trace - recorded events, timestamps relative to the first one
+void handleTraceAPI()
+{
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain", "");
+
+  char line[16 + TRACE_CHANNEL_SIZE + TRACE_PAYLOAD_SIZE];
+  uint32_t first = trace_count ? trace[trace_head].at_ms : 0;
+  for (uint8_t i = 0; i < trace_count; i++)
+  {
+    const TraceEvent &event = trace[(trace_head + i) % TRACE_CAPACITY];
+    int length = snprintf(line, sizeof(line), "%lu\t%c\t%s\t%s\n",
+                          (unsigned long)(event.at_ms - first), event.source, event.channel,
+                          event.payload);
+    server.sendContent(line, min((size_t)length, sizeof(line) - 1));
+  }
+  server.sendContent("");
+}
+
+// POST /api/trace/record?enable=1 clears the buffer and starts, enable=0 stops
+void handleTraceRecordAPI()
+{
+  trace_recording = server.arg("enable") == "1";
+  if (trace_recording)
+  {
+    trace_count = 0;
+    trace_head = 0;
+  }
+
+  Serial.printf("[✓] Trace recording %s\n", trace_recording ? "started" : "stopped");
+  server.send(200, "text/plain", "OK");
+}
+
+// POST /api/trace/replay?speed=<1-100> with a trace as body
+// Events overwrite the trace buffer as they are parsed, so a rejected body
+// also drops the previous trace and stops a replay still running from it
+void rejectTrace(const String &reason)
+{
+  trace_count = 0;
+  if (replay_active)
+  {
+    endReplay();
+  }
+  server.send(400, "text/plain", reason);
+}
+
+void handleTraceReplayAPI()
+{
+  String body = server.arg("plain");
+  uint8_t count = 0;
+  int start = 0;
+
+  while (start < (int)body.length())
+  {
+    int end = body.indexOf('\n', start);
+    if (end < 0)
+      end = body.length();
+    String line = body.substring(start, end);
+    start = end + 1;
+
+    line.trim();
+    if (line.length() == 0 || line[0] == '#')
+      continue;
+
+    if (count == TRACE_CAPACITY)
+    {
+      rejectTrace("Trace too long");
+      return;
+    }
+
+    // <ms>\t<source>\t<channel>\t<payload>, payload may be empty
+    int tab1 = line.indexOf('\t');
+    int tab2 = tab1 < 0 ? -1 : line.indexOf('\t', tab1 + 1);
+    if (tab2 < 0)
+    {
+      rejectTrace("Bad line: " + line);
+      return;
+    }
+    int tab3 = line.indexOf('\t', tab2 + 1);
+    if (tab3 < 0)
+      tab3 = line.length();
+
+    // runReplay() schedules relative to the first event, so timestamps must
+    // be plain numbers that never go backwards
+    char *digits_end;
+    String at = line.substring(0, tab1);
+    uint32_t at_ms = strtoul(at.c_str(), &digits_end, 10);
+    if (tab1 == 0 || *digits_end != 0 || !isdigit(at[0]))
+    {
+      rejectTrace("Bad timestamp: " + line);
+      return;
+    }
+    if (count > 0 && at_ms < trace[count - 1].at_ms)
+    {
+      rejectTrace("Timestamp goes backwards: " + line);
+      return;
+    }
+
+    TraceEvent &event = trace[count++];
+    event.at_ms = at_ms;
+    event.source = line[tab1 + 1];
+    line.substring(tab2 + 1, tab3).toCharArray(event.channel, TRACE_CHANNEL_SIZE);
+    String payload = line.substring(min((unsigned int)tab3 + 1, line.length()));
+    payload.toCharArray(event.payload, TRACE_PAYLOAD_SIZE);
+  }
+
+  trace_count = count;
+  trace_head = 0;
+  trace_recording = false;
+
+  if (replay_active)
+  {
+    endReplay(); // Snapshot the real settings, not the previous replay's
+  }
+  snapshotSettings();
+
+  replay_speed = constrain(server.hasArg("speed") ? server.arg("speed").toInt() : 1, 1, 100);
+  replay_index = 0;
+  replay_started = millis();
+  replay_active = count > 0;
+
+  replay_frames = 0;
+  late_frames = 0;
+  frame_late_max = 0;
+  last_frame_at = millis(); // Time spent idle before the replay is not lateness
+  loop_us_max = 0;
+  heap_min = ESP.getFreeHeap();
+  replay_commits_base = eeprom_commits;
+
+  Serial.printf("[→] Replaying %u events at %ux\n", count, replay_speed);
+  server.send(200, "text/plain", "OK");
+}
+
+void handleTraceReportAPI()
+{
+  StaticJsonDocument<384> doc;
+  doc["replaying"] = replay_active;
+  doc["events"] = trace_count;
+  doc["dispatched"] = replay_index;
+  doc["speed"] = replay_speed;
+  doc["duration_ms"] = replay_active ? millis() - replay_started : replay_duration;
+  doc["frames"] = replay_frames;
+  doc["late_frames"] = late_frames;
+  doc["frame_late_max_ms"] = frame_late_max;
+  doc["loop_us_max"] = loop_us_max;
+  doc["heap_min"] = heap_min;
+  doc["heap_fragmentation"] = ESP.getHeapFragmentation();
+  doc["eeprom_commits"] = eeprom_commits - replay_commits_base;
+
+  String json;
+  serializeJson(doc, json);
+  server.send(200, "application/json", json);
+}
+
+void runReplay()
+{
+  if (!replay_active)
+  {
+    return;
+  }
+
+  uint32_t first = trace[0].at_ms;
+  uint32_t virtual_now = (millis() - replay_started) * replay_speed;
+
+  while (replay_index < trace_count && trace[replay_index].at_ms - first <= virtual_now)
+  {
+    dispatchTraceEvent(trace[replay_index++]);
+  }
+
+  if (replay_index == trace_count)
+  {
+    // Let the last event render before closing the report
+    if (millis() - replay_started < (trace[trace_count - 1].at_ms - first) / replay_speed + 2000)
+    {
+      return;
+    }
+    endReplay();
+    replay_duration = millis() - replay_started;
+    Serial.printf("[✓] Replay done: %lu frames, %lu late (max %lu ms), %lu EEPROM commits\n",
+                  (unsigned long)replay_frames, (unsigned long)late_frames,
+                  (unsigned long)frame_late_max,
+                  (unsigned long)(eeprom_commits - replay_commits_base));
+  }
+}
+
+void snapshotSettings()
+{
+  replay_snapshot.brightness = brightness;
+  replay_snapshot.scroll_speed = scroll_speed;
+  replay_snapshot.mirror_fps = mirror_fps;
+  replay_snapshot.idle_timeout = idle_timeout;
+  strncpy(replay_snapshot.topic_base, topic_base, sizeof(replay_snapshot.topic_base));
+}
+
+// Put the live settings back the way the replay found them. Flash never saw
+// the replay's writes, see dispatchTraceEvent().
+void endReplay()
+{
+  replay_active = false;
+
+  if (brightness != replay_snapshot.brightness)
+  {
+    brightness = replay_snapshot.brightness;
+    display.setIntensity(brightness);
+  }
+  scroll_speed = replay_snapshot.scroll_speed;
+  mirror_fps = replay_snapshot.mirror_fps;
+  idle_timeout = replay_snapshot.idle_timeout;
+
+  if (strcmp(topic_base, replay_snapshot.topic_base) != 0)
+  {
+    strncpy(topic_base, replay_snapshot.topic_base, EEPROM_TOPIC_SIZE);
+    buildTopics();
+    mqtt_apply_pending = true; // Resubscribe on a fresh session
+  }
+  notifyStateChanged();
+}
+
+// Real commits happen right after their writes, so the EEPROM cache matches
+// flash outside this function. What the event wrote is dropped afterwards by
+// re-reading flash (EEPROM.begin()), real settings are never lost.
+void dispatchTraceEvent(const TraceEvent &event)
+{
+  char buffer[512];
+  strncpy(buffer, event.payload, sizeof(buffer));
+  ingest_at = millis();
+  uint32_t commits_before = eeprom_commits;
+  replay_dispatching = true;
+
+  if (event.source == TRACE_MQTT)
+  {
+    char topic[MQTT_TOPIC_SIZE];
+    snprintf(topic, sizeof(topic), "%s/%s", topic_base, event.channel);
+    if (strcmp(topic, topic_ota) == 0)
+    {
+      Serial.println("[!] Replay: ota event skipped"); // A trace must not flash firmware
+    }
+    else
+    {
+      handleMqttMessage(topic, buffer);
+    }
+  }
+  else if (event.source == TRACE_HTTP && strcmp(event.channel, "/api/settings") == 0)
+  {
+    StaticJsonDocument<256> doc;
+    String error;
+    if (!deserializeJson(doc, buffer))
+    {
+      applySettings(doc.as<JsonVariantConst>(), error);
+    }
+  }
+  else if (event.source == TRACE_HTTP && strcmp(event.channel, "/api/test-message") == 0)
+  {
+    updateDisplay(String(buffer));
+  }
+  else if (event.source == TRACE_SYSTEM && strcmp(event.channel, "disconnect") == 0)
+  {
+    mqtt.disconnect();
+  }
+  ingest_at = 0;
+  replay_dispatching = false;
+
+  if (eeprom_commits != commits_before)
+  {
+    EEPROM.begin(EEPROM_SIZE);
+  }
+}
+
+// ============ Latency ============
+// Time from a track message arriving (MQTT callback or replay) to the first
+// frame where the new text is lit, bucketed by what else the device was doing.
+void startLatency()
+{
+  if (ingest_at == 0)
+  {
+    return; // Not an MQTT message (test message from the web UI)
+  }
+
+  if (latency_pending)
+  {
+    latency_superseded++;
+  }
+
+  unsigned long now = millis();
+  latency_start = ingest_at;
+  ingest_at = 0;
+  latency_pending = true;
+
+  if (mqtt_connected_at != 0 && now - mqtt_connected_at < LATENCY_RECONNECT_WINDOW)
+    latency_condition = LATENCY_RECONNECT;
+  else if (last_http_request != 0 && now - last_http_request < LATENCY_HTTP_WINDOW)
+    latency_condition = LATENCY_HTTP_LOAD;
+  else
+    latency_condition = LATENCY_IDLE;
+}
+
+// Called by loopMessage() right after the scroll animation ran, cheap unless a
+// message is waiting for its first frame
+void checkLatency()
+{
+  if (!latency_pending)
   {
-    server.send(400, "text/plain", "Missing text");
     return;
   }
 
-  String test_msg = server.arg("text");
-  Serial.printf("[→] Test message received: %s\n", test_msg.c_str());
-  updateDisplay(test_msg);
+  // READY and the OTA progress bar are drawn over the scroll, wait for the text itself
+  if (!ready_shown || ota_active)
+  {
+    return;
+  }
 
-  server.send(200, "text/plain", "OK");
+  if (frameLit<Geometry>(*display.getGraphicObject()))
+  {
+    latency_pending = false;
+    recordLatency(latency[latency_condition], millis() - latency_start);
+  }
+}
+
+void recordLatency(LatencyStats &stats, uint32_t ms)
+{
+  uint32_t bound = 10;
+  uint8_t bucket = 0;
+  while (bucket < LATENCY_BUCKETS - 1 && ms > bound)
+  {
+    bound = bound * 6 / 5 + 1;
+    bucket++;
+  }
+
+  if (stats.buckets[bucket] < UINT16_MAX)
+    stats.buckets[bucket]++;
+  stats.count++;
+  if (ms > stats.max_ms)
+    stats.max_ms = ms;
+}
+
+// Upper bound of the bucket holding the given percentile (within 20%)
+uint32_t latencyPercentile(const LatencyStats &stats, uint8_t percent)
+{
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+    total += stats.buckets[i];
+  if (total == 0)
+    return 0;
+
+  uint32_t target = (total * percent + 99) / 100;
+  uint32_t seen = 0;
+  uint32_t bound = 10;
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+  {
+    seen += stats.buckets[i];
+    if (seen >= target)
+      return min(bound, stats.max_ms);
+    bound = bound * 6 / 5 + 1;
+  }
+  return stats.max_ms;
+}
+
+// GET /api/latency[?reset=1]
+void handleLatencyAPI()
+{
+  static const char *const names[LATENCY_CONDITIONS] = {"idle", "http_load", "reconnect"};
+
+  StaticJsonDocument<512> doc;
+  for (uint8_t c = 0; c < LATENCY_CONDITIONS; c++)
+  {
+    JsonObject stats = doc.createNestedObject(names[c]);
+    stats["count"] = latency[c].count;
+    stats["p50_ms"] = latencyPercentile(latency[c], 50);
+    stats["p99_ms"] = latencyPercentile(latency[c], 99);
+    stats["max_ms"] = latency[c].max_ms;
+  }
+  doc["superseded"] = latency_superseded;
+
+  // latency-suite.sh turns this on for its run and off at the end
+  if (server.hasArg("suite"))
+  {
+    latency_suite = server.arg("suite") == "1";
+  }
+  doc["suite"] = latency_suite;
+
+  String json;
+  serializeJson(doc, json);
+
+  if (server.arg("reset") == "1")
+  {
+    memset(latency, 0, sizeof(latency));
+    latency_superseded = 0;
+  }
+
+  server.send(200, "application/json", json);
+}
+
+// ============ Home Assistant ============
+// Discovery configs are published once per connection, one per loop() pass.
+// State changes only mark the retained state document dirty; it is published
+// at most once per HA_STATE_INTERVAL. Both are built in ha_buffer, no heap use.
+void handleHomeAssistant()
+{
+  if (ha_discovery_next < DISCOVERY_COUNT)
+  {
+    if (publishDiscovery(discovery_entities[ha_discovery_next]))
+      ha_discovery_next++;
+    return;
+  }
+
+  unsigned long now = millis();
+  if (now - ha_last_publish >= HA_STATE_REFRESH)
+  {
+    ha_state_dirty = true;
+  }
+
+  if (ha_state_dirty && now - ha_last_publish >= HA_STATE_INTERVAL)
+  {
+    if (publishState())
+    {
+      ha_state_dirty = false;
+      ha_last_publish = now;
+    }
+  }
+}
+
+bool publishDiscovery(const DiscoveryEntity &entity)
+{
+  char topic[96];
+  snprintf(topic, sizeof(topic), "%s/%s/%s/%s/config", HA_DISCOVERY_PREFIX, entity.component,
+           config.client_id, entity.key);
+
+  int length = snprintf(ha_buffer, HA_BUFFER_SIZE,
+                        "{\"~\":\"%s\",\"name\":\"%s\",\"uniq_id\":\"%s_%s\","
+                        "\"stat_t\":\"~/status\",\"val_tpl\":\"{{value_json.%s}}\","
+                        "\"avty_t\":\"~/availability\",%s"
+                        "\"dev\":{\"ids\":[\"%s\"],\"name\":\"Spotify Display\","
+                        "\"mdl\":\"ESP8266 MAX7219\",\"sw\":\"%s\"}}",
+                        topic_base, entity.name, config.client_id, entity.key, entity.key,
+                        entity.extra, config.client_id, FIRMWARE_VERSION);
+  if (length <= 0 || length >= HA_BUFFER_SIZE)
+  {
+    Serial.printf("[!] Discovery config too large: %s\n", entity.key);
+    return true; // Skip it rather than retrying forever
+  }
+
+  return mqtt.publish(topic, (const uint8_t *)ha_buffer, length, true);
+}
+
+// Longest prefix of text up to max bytes that does not split a UTF-8 character
+size_t utf8Prefix(const char *text, size_t max)
+{
+  size_t length = strnlen(text, max + 1);
+  if (length <= max)
+  {
+    return length;
+  }
+
+  while (max > 0 && ((uint8_t)text[max] & 0xC0) == 0x80)
+    max--; // Continuation byte, cut before the character it belongs to
+  return max;
+}
+
+bool publishState()
+{
+  // The display shows 64 chars, cap the track so the escaped document always fits.
+  // HA drops payloads that are not valid UTF-8, so never cut inside a character.
+  char track[81];
+  size_t track_length = utf8Prefix(current_message.c_str(), sizeof(track) - 1);
+  memcpy(track, current_message.c_str(), track_length);
+  track[track_length] = 0;
+
+  StaticJsonDocument<256> doc;
+  doc["brightness"] = brightness;
+  doc["scroll_speed"] = scroll_speed;
+  doc["track"] = (const char *)track;
+  doc["display"] = display_enabled ? "active" : "idle";
+  doc["rssi"] = WiFi.RSSI();
+  doc["heap"] = ESP.getFreeHeap();
+
+  size_t length = serializeJson(doc, ha_buffer, HA_BUFFER_SIZE);
+  return mqtt.publish(topic_status, (const uint8_t *)ha_buffer, length, true);
+}
+
+// ============ Track History ============
+void setupHistory()
+{
+  if (!LittleFS.begin())
+  {
+    Serial.println("[!] LittleFS mount failed, history disabled");
+    return;
+  }
+  LittleFS.mkdir(HISTORY_DIR);
+
+  // Find the oldest and newest segments
+  bool found = false;
+  Dir dir = LittleFS.openDir(HISTORY_DIR);
+  while (dir.next())
+  {
+    uint32_t seq = strtoul(dir.fileName().c_str(), nullptr, 10);
+    if (!found || seq < history_first_seq)
+      history_first_seq = seq;
+    if (!found || seq > history_seq)
+      history_seq = seq;
+    found = true;
+  }
+
+  // Count lines in the current segment, once per boot
+  char path[32];
+  historySegmentPath(path, sizeof(path), history_seq);
+  File file = LittleFS.open(path, "r");
+  if (file)
+  {
+    uint8_t chunk[128];
+    size_t length;
+    while ((length = file.read(chunk, sizeof(chunk))) > 0)
+    {
+      for (size_t i = 0; i < length; i++)
+      {
+        if (chunk[i] == '\n')
+          history_segment_entries++;
+      }
+    }
+    file.close();
+  }
+
+  // Wall-clock timestamps once NTP answers, uptime until then
+  configTime(0, 0, NTP_SERVER);
+
+  history_ready = true;
+  Serial.printf("[✓] History: segments %lu-%lu, %u entries in current\n",
+                (unsigned long)history_first_seq, (unsigned long)history_seq,
+                history_segment_entries);
+}
+
+void historySegmentPath(char *path, size_t size, uint32_t seq)
+{
+  snprintf(path, size, HISTORY_DIR "/%lu.log", (unsigned long)seq);
+}
+
+// Ingest side: format into the RAM queue, never touches flash
+void queueHistory(const String &track)
+{
+  if (!history_ready || track == history_last_track)
+  {
+    return;
+  }
+  history_last_track = track;
+
+  if (history_pending == HISTORY_QUEUE)
+  {
+    history_dropped++; // loop() flushes well before this in practice
+    return;
+  }
+
+  time_t now = time(nullptr);
+  StaticJsonDocument<192> doc;
+  doc["t"] = now > 1600000000 ? (uint32_t)now : 0; // 0 = clock not synced yet
+  doc["up"] = millis() / 1000;
+  doc["track"] = track.c_str();
+
+  // Shorten the track until the escaped line fits with its '\n', never
+  // splitting a UTF-8 character, so every line stays valid JSON
+  char shortened[HISTORY_LINE_SIZE];
+  size_t keep = track.length();
+  size_t measured;
+  while ((measured = measureJson(doc)) > HISTORY_LINE_SIZE - 2)
+  {
+    size_t over = measured - (HISTORY_LINE_SIZE - 2);
+    keep = utf8Prefix(track.c_str(), keep > over ? keep - over : 0);
+    memcpy(shortened, track.c_str(), keep);
+    shortened[keep] = 0;
+    doc["track"] = (const char *)shortened;
+  }
+
+  char *line = history_queue[history_pending];
+  size_t length = serializeJson(doc, line, HISTORY_LINE_SIZE - 1);
+  line[length] = '\n';
+  line[length + 1] = 0;
+
+  if (history_pending == 0)
+    history_oldest_pending = millis();
+  history_pending++;
+}
+
+void handleHistory()
+{
+  if (history_pending == 0)
+  {
+    return;
+  }
+
+  // Flush when the queue is nearly full or a track has waited long enough
+  if (history_pending >= HISTORY_QUEUE - 2 ||
+      millis() - history_oldest_pending >= HISTORY_FLUSH_INTERVAL)
+  {
+    flushHistory();
+  }
+}
+
+// Append all queued lines, rotating segments as they fill up
+void flushHistory()
+{
+  if (!history_ready || history_pending == 0)
+  {
+    return;
+  }
+
+  char path[32];
+  historySegmentPath(path, sizeof(path), history_seq);
+  File file = LittleFS.open(path, "a");
+
+  for (uint8_t i = 0; i < history_pending && file; i++)
+  {
+    if (history_segment_entries >= HISTORY_SEGMENT_ENTRIES)
+    {
+      file.close();
+      history_seq++;
+      history_segment_entries = 0;
+
+      while (history_seq - history_first_seq >= HISTORY_SEGMENTS)
+      {
+        historySegmentPath(path, sizeof(path), history_first_seq++);
+        LittleFS.remove(path);
+      }
+
+      historySegmentPath(path, sizeof(path), history_seq);
+      file = LittleFS.open(path, "a");
+    }
+
+    file.write((const uint8_t *)history_queue[i], strlen(history_queue[i]));
+    history_segment_entries++;
+  }
+
+  if (file)
+    file.close();
+  history_pending = 0;
+  history_flushes++;
+}
+
+// GET /api/history - NDJSON, oldest first, streamed from flash in small chunks
+void handleHistoryAPI()
+{
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/x-ndjson", "");
+
+  if (history_ready)
+  {
+    char path[32];
+    uint8_t chunk[256];
+    for (uint32_t seq = history_first_seq; seq <= history_seq; seq++)
+    {
+      historySegmentPath(path, sizeof(path), seq);
+      File file = LittleFS.open(path, "r");
+      if (!file)
+        continue;
+
+      size_t length;
+      while ((length = file.read(chunk, sizeof(chunk))) > 0)
+      {
+        server.sendContent((const char *)chunk, length);
+      }
+      file.close();
+    }
+
+    // Tracks not flushed yet
+    for (uint8_t i = 0; i < history_pending; i++)
+    {
+      server.sendContent(history_queue[i], strlen(history_queue[i]));
+    }
+  }
+  server.sendContent("");
+}
+
+// ============ Idle Mode ============
+void setPlaying(bool now_playing)
+{
+  if (now_playing)
+  {
+    wakeDisplay();
+  }
+  else if (playing)
+  {
+    idle_since = millis();
+  }
+  playing = now_playing;
+}
+
+// Fade out and shut the MAX7219 down after idle_timeout seconds without
+// playback. Anything that needs the display (playback, lost MQTT, OTA) wakes it.
+void updatePowerState()
+{
+  bool may_idle = idle_timeout > 0 && !playing && ready_shown && mqtt.connected() && !ota_active;
+  if (!may_idle)
+  {
+    wakeDisplay();
+    return;
+  }
+
+  if (!display_enabled)
+  {
+    return;
+  }
+
+  unsigned long now = millis();
+  if (fade_level < 0)
+  {
+    if (now - idle_since < (unsigned long)idle_timeout * 1000)
+    {
+      return;
+    }
+    Serial.println("[→] Idle, fading out");
+    fade_level = brightness;
+    fade_last_step = now;
+  }
+
+  if (now - fade_last_step < IDLE_FADE_STEP)
+  {
+    return;
+  }
+  fade_last_step = now;
+
+  if (fade_level > 0)
+  {
+    display.setIntensity(--fade_level);
+    return;
+  }
+
+  // Intensity 0 is still lit on the MAX7219, shut it down and stop animating
+  accountPowerTime();
+  display.displayShutdown(true);
+  display_enabled = false;
+  fade_level = -1;
+
+  // The SDK only applies modem sleep in STA-only mode, so the soft AP goes
+  // down while idle. Idling requires MQTT, so STA is connected here.
+  sleep_before_idle = WiFi.getSleepMode();
+  if (WiFi.getMode() == WIFI_AP_STA)
+  {
+    WiFi.softAPdisconnect(true);
+    ap_stopped_for_idle = true;
+  }
+  WiFi.setSleepMode(WIFI_MODEM_SLEEP);
+  notifyStateChanged();
+  Serial.println("[✓] Display idle, soft AP off, modem sleep enabled");
+}
+
+void wakeDisplay()
+{
+  if (display_enabled && fade_level < 0)
+  {
+    return;
+  }
+
+  if (!display_enabled)
+  {
+    accountPowerTime();
+    display.displayShutdown(false);
+    display_enabled = true;
+    last_frame_at = millis(); // Frames resume now, the idle gap is not lateness
+    WiFi.setSleepMode(sleep_before_idle);
+    if (ap_stopped_for_idle)
+    {
+      startSoftAP();
+      ap_stopped_for_idle = false;
+    }
+    notifyStateChanged();
+    Serial.println("[✓] Display awake");
+  }
+  fade_level = -1;
+  display.setIntensity(brightness);
+}
+
+void accountPowerTime()
+{
+  unsigned long now = millis();
+  if (display_enabled)
+    active_ms += now - power_state_since;
+  else
+    idle_ms += now - power_state_since;
+  power_state_since = now;
+}
+
+// Advance the animation. Parola pushes a new frame over SPI once per
+// scroll_speed ms, frames_pushed mirrors that tick.
+bool animateDisplay()
+{
+  unsigned long elapsed = millis() - last_frame_at;
+  if (elapsed >= (unsigned long)scroll_speed)
+  {
+    last_frame_at = millis();
+    frames_pushed++;
+
+    if (replay_active)
+    {
+      uint32_t late = elapsed - scroll_speed;
+      replay_frames++;
+      if (late > (uint32_t)scroll_speed / 2)
+        late_frames++;
+      if (late > frame_late_max)
+        frame_late_max = late;
+    }
+  }
+  return display.displayAnimate();
 }
 
 // ============ Display ============
@@ -819,51 +3125,41 @@ void setupDisplay()
 void updateDisplay(const String &message)
 {
   current_message = message;
+  notifyStateChanged();
   Serial.printf("[→] Displaying: %s\n", message.c_str());
 
+  // An empty message means playback stopped
+  setPlaying(message.length() > 0);
+
   // Handle empty message - clear display
   if (message.length() == 0)
   {
     display.displayClear();
     message_looping = false;
-    scroll_text = "";
+    scroll_text[0] = 0;
+    latency_pending = false; // Cleared before it was shown
     Serial.println("[→] Display cleared");
     return;
   }
 
-  // Save this message to EEPROM for persistence
-  saveLastMessage(message);
-
-  // Convert to uppercase
-  String display_text = message;
-  display_text.toUpperCase();
-
-  // Remove non-ASCII characters (MAX7219 only supports ASCII)
-  String clean_text = "";
-  for (unsigned int i = 0; i < display_text.length(); i++)
-  {
-    char c = display_text[i];
-    if (c >= 32 && c <= 126)
-    {
-      clean_text += c;
-    }
-  }
-  display_text = clean_text;
+  // Time until the new text is first visible
+  startLatency();
 
-  // Trim to reasonable length
-  if (display_text.length() > 64)
+  // Save this message to EEPROM for persistence
+  if (!latency_suite)
   {
-    display_text = display_text.substring(0, 64);
+    saveLastMessage(message);
   }
 
-  // Add padding spaces for proper scrolling
-  scroll_text = "    " + display_text + "    ";
+  // Uppercase, ASCII only (MAX7219 font), trimmed and padded for scrolling
+  buildScrollText<Geometry>(message.c_str(), scroll_text);
 
   // Clear and setup scrolling (ONLY ONCE)
   display.displayClear();
   display.setTextAlignment(PA_LEFT);
   display.setCharSpacing(1);
-  display.displayScroll(scroll_text.c_str(), PA_LEFT, PA_SCROLL_LEFT, scroll_speed);
+  display.displayScroll(scroll_text, PA_LEFT, PA_SCROLL_LEFT, scroll_speed);
+  last_frame_at = millis();
 
   // Mark that we're looping a message
   message_looping = true;
@@ -872,12 +3168,105 @@ void updateDisplay(const String &message)
 // Helper to continue looping the current message
 void loopMessage()
 {
-  if (message_looping && scroll_text.length() > 0)
+  if (message_looping && scroll_text[0] != 0)
   {
-    if (display.displayAnimate())
+    bool finished = animateDisplay();
+    checkLatency();
+
+    if (finished)
     {
       // Scroll finished, restart it - but use the SAME stored text
-      display.displayScroll(scroll_text.c_str(), PA_LEFT, PA_SCROLL_LEFT, scroll_speed);
+      display.displayScroll(scroll_text, PA_LEFT, PA_SCROLL_LEFT, scroll_speed);
     }
   }
 }
+
+// ============ Render Benchmark ============
+#ifdef RENDER_BENCH
+#define RENDER_BENCH_FRAMES 2000
+
+// The mirror encoder with the column count passed at runtime, as a
+// module-agnostic helper would take it. Only built for the comparison.
+size_t encodeMirrorFrameRuntime(const uint8_t *columns, uint16_t count, uint8_t *prev,
+                                bool keyframe, uint8_t *frame)
+{
+  size_t mask_bytes = (count + 7) / 8;
+
+  if (keyframe)
+  {
+    frame[0] = MIRROR_KEYFRAME;
+    for (uint16_t i = 0; i < count; i++)
+    {
+      prev[i] = columns[i];
+      frame[1 + i] = columns[i];
+    }
+    return 1 + count;
+  }
+
+  frame[0] = MIRROR_DELTA;
+  memset(frame + 1, 0, mask_bytes);
+  size_t length = 1 + mask_bytes;
+  for (uint16_t i = 0; i < count; i++)
+  {
+    uint8_t column = columns[i];
+    if (column != prev[i])
+    {
+      prev[i] = column;
+      frame[1 + i / 8] |= 1 << (i % 8);
+      frame[length++] = column;
+    }
+  }
+  return length == 1 + mask_bytes ? 0 : length;
+}
+
+// Time keyframes and all-columns-changed deltas of one captured test pattern
+// through both encoders, printed to serial once at boot. Both read the same
+// snapshot, so the loops are compared rather than MD_MAX72XX::getColumn().
+void runRenderBench()
+{
+  MD_MAX72XX &matrix = *display.getGraphicObject();
+  for (uint8_t i = 0; i < Geometry::kColumns; i++)
+  {
+    matrix.setColumn(i, 0x55 << (i % 2));
+  }
+
+  uint8_t columns[Geometry::kColumns];
+  captureFrame<Geometry>(matrix, columns);
+  uint16_t count = matrix.getColumnCount();
+
+  uint8_t prev[Geometry::kColumns];
+  uint8_t frame[Geometry::kFrameSize];
+  const char *names[] = {"keyframe", "delta"};
+  size_t checksum = 0; // Keeps the loops from being optimized out
+
+  for (uint8_t pass = 0; pass < 2; pass++)
+  {
+    bool keyframe = pass == 0;
+
+    unsigned long start = micros();
+    for (uint16_t n = 0; n < RENDER_BENCH_FRAMES; n++)
+    {
+      memset(prev, n, sizeof(prev)); // Stale prev, (nearly) every column is re-sent
+      checksum += encodeMirrorFrame<Geometry>(columns, prev, keyframe, frame);
+    }
+    unsigned long specialized = micros() - start;
+    yield();
+
+    start = micros();
+    for (uint16_t n = 0; n < RENDER_BENCH_FRAMES; n++)
+    {
+      memset(prev, n, sizeof(prev));
+      checksum += encodeMirrorFrameRuntime(columns, count, prev, keyframe, frame);
+    }
+    unsigned long runtime = micros() - start;
+    yield();
+
+    Serial.printf("[bench] %s x%d: specialized %lu us, runtime %lu us (%lu ns/frame vs %lu)\n",
+                  names[pass], RENDER_BENCH_FRAMES, specialized, runtime,
+                  specialized * 1000 / RENDER_BENCH_FRAMES, runtime * 1000 / RENDER_BENCH_FRAMES);
+  }
+
+  Serial.printf("[bench] checksum %u\n", (unsigned)checksum);
+  matrix.clear();
+}
+#endif
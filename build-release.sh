@@ -56,6 +56,7 @@ fi
 # Get file info
 SIZE=$(ls -lh "$RELEASE_DIR/$FIRMWARE_NAME" | awk '{print $5}')
 SHA=$(shasum -a 256 "$RELEASE_DIR/$FIRMWARE_NAME" | awk '{print $1}')
+MD5=$(openssl md5 -r "$RELEASE_DIR/$FIRMWARE_NAME" | awk '{print $1}')
 
 echo ""
 echo "✅ Firmware built successfully!"
@@ -64,8 +65,12 @@ echo "📋 Release Info:"
 echo "   File: $FIRMWARE_NAME"
 echo "   Size: $SIZE"
 echo "   SHA256: $SHA"
+echo "   MD5:    $MD5 (required for OTA)"
 echo ""
 echo "📖 To flash this firmware:"
 echo "   esptool.py -p /dev/cu.usbserial-XXXX write_flash 0x0 $RELEASE_DIR/$FIRMWARE_NAME"
 echo ""
+echo "📡 Or over the air:"
+echo "   curl -u admin:<update password> -F \"firmware=@$RELEASE_DIR/$FIRMWARE_NAME\" \"http://esp8266-spotify.local/update?md5=$MD5\""
+echo ""
 echo "📂 Output: $RELEASE_DIR/$FIRMWARE_NAME"
@@ -0,0 +1,88 @@
+#!/bin/bash
+# Measure track latency on a running device and print p50/p99 per condition
+#
+# Runs against real hardware: samples are timed on the device, from the MQTT callback to
+# the first frame showing the track. Broker and network time before the callback is not
+# included. While the suite runs, the device shows its tracks but does not add them to the
+# track history or save them as the last message.
+#
+# Usage: BROKER=192.168.1.10 ./latency-suite.sh [tracks per condition, default 50]
+#
+# Environment:
+#   BROKER               MQTT broker host (required)
+#   DEVICE               Device hostname or IP (default esp8266-spotify.local)
+#   TOPIC                MQTT topic base (default home_assistant/spotify)
+#   MQTT_USER/MQTT_PASS  Broker credentials, if any
+#   INTERVAL             Seconds between tracks (default 3)
+
+set -e
+
+COUNT=${1:-50}
+DEVICE=${DEVICE:-esp8266-spotify.local}
+TOPIC=${TOPIC:-home_assistant/spotify}
+INTERVAL=${INTERVAL:-3}
+TRACE="ESP_DispSpotTrack/traces/reconnect_only.trace"
+
+if [ -z "$BROKER" ]; then
+  echo "❌ Set BROKER to the MQTT broker host"
+  exit 1
+fi
+
+for tool in mosquitto_pub curl jq; do
+  if ! command -v "$tool" >/dev/null 2>&1; then
+    echo "❌ $tool not found"
+    exit 1
+  fi
+done
+
+MQTT_ARGS=(-h "$BROKER")
+if [ -n "$MQTT_USER" ]; then
+  MQTT_ARGS+=(-u "$MQTT_USER" -P "$MQTT_PASS")
+fi
+
+publish_tracks() {
+  for i in $(seq "$COUNT"); do
+    mosquitto_pub "${MQTT_ARGS[@]}" -t "$TOPIC/current" -m "Latency Suite - $1 $i"
+    sleep "$INTERVAL"
+  done
+}
+
+# Retained track for the reconnect step, published first so its own delivery is not counted
+mosquitto_pub "${MQTT_ARGS[@]}" -r -t "$TOPIC/current" -m "Latency Suite - retained"
+sleep 1
+
+echo "🔄 Resetting latency counters on $DEVICE..."
+curl -sf "http://$DEVICE/api/latency?reset=1&suite=1" >/dev/null
+trap 'curl -s "http://$DEVICE/api/latency?suite=0" >/dev/null' EXIT
+
+echo "⏱️  Idle: $COUNT tracks, ${INTERVAL}s apart..."
+publish_tracks idle
+
+echo "⏱️  HTTP load: $COUNT tracks while hammering /api/status..."
+(while true; do curl -s "http://$DEVICE/api/status" >/dev/null; done) &
+LOAD_PID=$!
+trap 'kill $LOAD_PID 2>/dev/null; curl -s "http://$DEVICE/api/latency?suite=0" >/dev/null' EXIT
+publish_tracks http_load
+kill $LOAD_PID
+wait $LOAD_PID 2>/dev/null || true
+trap 'curl -s "http://$DEVICE/api/latency?suite=0" >/dev/null' EXIT
+
+# The trace only drops the MQTT session. Every reconnect redelivers the retained track,
+# which lands under "reconnect" (that condition wins over the report polling below).
+echo "⏱️  Reconnect: replaying $(basename "$TRACE") with a retained track..."
+curl -sf -X POST --data-binary @"$TRACE" "http://$DEVICE/api/trace/replay?speed=1" >/dev/null
+while curl -s "http://$DEVICE/api/trace/report" | jq -e '.replaying' >/dev/null; do
+  sleep 2
+done
+sleep 10 # Last reconnect (5s retry interval) and its first frame
+
+# Remove the retained test track (the device sees an empty message and clears)
+mosquitto_pub "${MQTT_ARGS[@]}" -r -n -t "$TOPIC/current"
+
+echo ""
+echo "📊 Latency (ms):"
+curl -sf "http://$DEVICE/api/latency" | jq -r '
+  (["condition", "count", "p50", "p99", "max"] | @tsv),
+  (to_entries[] | select(.value | type == "object")
+    | [.key, .value.count, .value.p50_ms, .value.p99_ms, .value.max_ms] | @tsv),
+  "superseded\t\(.superseded)"'